@@ -0,0 +1,204 @@
+/*
+ * Node local memory for the per thread data of cyclictest
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include "arena.h"
+
+struct arena_chunk {
+	struct arena_chunk *next;
+	char *base;
+	size_t size;
+	size_t used;
+	int node;
+};
+
+static struct arena_chunk *chunks;
+
+static long arena_mbind(void *addr, size_t len, int node)
+{
+	unsigned long mask[16] = { 0 };
+
+	if (node < 0 || node >= (int)(8 * sizeof(mask)))
+		return 0;
+	mask[node / (8 * sizeof(long))] = 1UL << (node % (8 * sizeof(long)));
+	/* preferred rather than bound, a full node is not fatal */
+	return syscall(SYS_mbind, addr, len, MPOL_PREFERRED, mask,
+		       8 * sizeof(mask), MPOL_MF_MOVE);
+}
+
+/*
+ * Map len bytes for node. The mapping starts out inaccessible so that
+ * an earlier mlockall(MCL_FUTURE) does not fault it in before the huge
+ * page advice and the node binding are in place; making it writable
+ * then populates it, and the memset does for unlocked memory.
+ */
+static struct arena_chunk *arena_map(size_t len, int node)
+{
+	struct arena_chunk *c;
+	size_t head;
+	char *p;
+
+	c = calloc(1, sizeof(*c));
+	if (!c)
+		return NULL;
+
+	p = mmap(NULL, len, PROT_NONE,
+		 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (p == MAP_FAILED) {
+		/* no hugetlb pages, align for transparent ones */
+		p = mmap(NULL, len + ARENA_CHUNK, PROT_NONE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED) {
+			free(c);
+			return NULL;
+		}
+		head = -(uintptr_t)p & (ARENA_CHUNK - 1);
+		if (head)
+			munmap(p, head);
+		munmap(p + head + len, ARENA_CHUNK - head);
+		p += head;
+#ifdef MADV_HUGEPAGE
+		madvise(p, len, MADV_HUGEPAGE);
+#endif
+	}
+	arena_mbind(p, len, node);
+	if (mprotect(p, len, PROT_READ | PROT_WRITE)) {
+		munmap(p, len);
+		free(c);
+		return NULL;
+	}
+	memset(p, 0, len);
+
+	c->base = p;
+	c->size = len;
+	c->node = node;
+	c->next = chunks;
+	chunks = c;
+	return c;
+}
+
+void *arena_alloc(size_t size, int node)
+{
+	struct arena_chunk *c;
+	void *p;
+
+	if (node < 0)
+		node = -1;
+	size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+	for (c = chunks; c; c = c->next)
+		if (c->node == node && c->size - c->used >= size)
+			break;
+	if (!c) {
+		c = arena_map((size + ARENA_CHUNK - 1) & ~(ARENA_CHUNK - 1), node);
+		if (!c)
+			return NULL;
+	}
+	p = c->base + c->used;
+	c->used += size;
+	return p;
+}
+
+void arena_release(void)
+{
+	struct arena_chunk *c;
+
+	while ((c = chunks)) {
+		chunks = c->next;
+		munmap(c->base, c->size);
+		free(c);
+	}
+}
+
+int arena_node_of_cpu(int cpu)
+{
+	char path[64];
+	struct dirent *d;
+	int node = -1;
+	DIR *dir;
+
+	if (cpu < 0)
+		return -1;
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+	dir = opendir(path);
+	if (!dir)
+		return -1;
+	while ((d = readdir(dir)))
+		if (!strncmp(d->d_name, "node", 4) &&
+		    d->d_name[4] >= '0' && d->d_name[4] <= '9') {
+			node = atoi(d->d_name + 4);
+			break;
+		}
+	closedir(dir);
+	return node;
+}
+
+int arena_node_count(void)
+{
+	char buf[256], *p;
+	int nodes = 1;
+	FILE *fp;
+
+	fp = fopen("/sys/devices/system/node/online", "r");
+	if (!fp)
+		return 1;
+	if (fgets(buf, sizeof(buf), fp)) {
+		/* "0-3" or "0,2": the last number is the highest node */
+		for (p = buf + strlen(buf); p > buf && (p[-1] < '0' || p[-1] > '9'); p--)
+			;
+		while (p > buf && p[-1] >= '0' && p[-1] <= '9')
+			p--;
+		nodes = atoi(p) + 1;
+	}
+	fclose(fp);
+	return nodes;
+}
+
+int arena_node_online(int node)
+{
+	char buf[256], *p = buf;
+	int first, last, online = 0;
+	FILE *fp;
+
+	fp = fopen("/sys/devices/system/node/online", "r");
+	if (!fp)
+		return node == 0;
+	if (fgets(buf, sizeof(buf), fp)) {
+		/* "0-3" or "0,2" */
+		while (*p >= '0' && *p <= '9') {
+			first = last = strtol(p, &p, 10);
+			if (*p == '-')
+				last = strtol(p + 1, &p, 10);
+			if (node >= first && node <= last) {
+				online = 1;
+				break;
+			}
+			if (*p != ',')
+				break;
+			p++;
+		}
+	}
+	fclose(fp);
+	return online;
+}
+
+int arena_node_of(const void *addr)
+{
+	void *page = (void *)((uintptr_t)addr & ~(uintptr_t)(sysconf(_SC_PAGESIZE) - 1));
+	int status = -1;
+
+	if (!addr || syscall(SYS_move_pages, 0, 1UL, &page, NULL, &status, 0))
+		return -1;
+	return status < 0 ? -1 : status;
+}
@@ -0,0 +1,38 @@
+/*
+ * arena.h - node local memory for the per thread data of cyclictest
+ *
+ * Blocks are carved from anonymous mappings of whole huge pages. Each
+ * mapping is bound to one memory node, backed by hugetlb pages if the
+ * system has some reserved and by transparent huge pages otherwise, and
+ * faulted in before the first block is handed out, so the measurement
+ * threads neither take page faults nor write to remote memory. Blocks
+ * are cache line aligned and live until arena_release().
+ *
+ * Only system calls are used, libnuma is not needed.
+ */
+
+#ifndef __ARENA_H
+#define __ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_ALIGN		64
+#define ARENA_CHUNK		(2UL << 20)
+
+/* Block of size bytes on node, or anywhere if node is negative */
+void *arena_alloc(size_t size, int node);
+void arena_release(void);
+
+/* Memory node of a cpu from sysfs, -1 if it is not known */
+int arena_node_of_cpu(int cpu);
+
+/* Highest online memory node plus one, 1 without sysfs */
+int arena_node_count(void);
+
+/* Whether node is online, only node 0 is without sysfs */
+int arena_node_online(int node);
+
+/* Node the page holding addr is on now (move_pages query), -1 if unknown */
+int arena_node_of(const void *addr);
+
+#endif	/* __ARENA_H */
@@ -0,0 +1,245 @@
+/*
+ * Isolation audit of the measurement cpus for cyclictest --audit
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <dirent.h>
+#include <time.h>
+#include "audit.h"
+
+const char *audit_flag_names[AUDIT_FLAGS] = {
+	[AUDIT_NOT_ISOLATED]	= "not isolated",
+	[AUDIT_NO_NOHZ_FULL]	= "no nohz_full",
+	[AUDIT_NO_RCU_NOCBS]	= "no rcu_nocbs",
+	[AUDIT_WORKQUEUE]	= "unbound workqueues",
+	[AUDIT_IRQ]		= "device interrupts",
+};
+
+/* Read a small sysfs or procfs file, 0 if it is not there */
+static int audit_read(const char *path, char *buf, size_t len)
+{
+	FILE *fp = fopen(path, "r");
+	size_t n;
+
+	if (!fp)
+		return 0;
+	n = fread(buf, 1, len - 1, fp);
+	fclose(fp);
+	buf[n] = '\0';
+	return 1;
+}
+
+/* "0-3,8,10-11" as in /sys/devices/system/cpu/isolated */
+static void audit_cpulist(const char *s, cpu_set_t *set)
+{
+	unsigned long first, last;
+	char *end;
+
+	CPU_ZERO(set);
+	while (*s && !isspace((unsigned char)*s)) {
+		first = last = strtoul(s, &end, 10);
+		if (end == s)
+			return;
+		if (*end == '-')
+			last = strtoul(end + 1, &end, 10);
+		for (; first <= last && first < CPU_SETSIZE; first++)
+			CPU_SET(first, set);
+		s = *end == ',' ? end + 1 : end;
+	}
+}
+
+/* "ff,ffffffff" as in /proc/irq/N/smp_affinity, low bits last */
+static void audit_hexmask(const char *s, cpu_set_t *set)
+{
+	const char *p = s + strlen(s);
+	unsigned int bit = 0, v, k;
+
+	CPU_ZERO(set);
+	while (p-- > s) {
+		if (!isxdigit((unsigned char)*p))
+			continue;
+		v = isdigit((unsigned char)*p) ? *p - '0' :
+			tolower((unsigned char)*p) - 'a' + 10;
+		for (k = 0; k < 4 && bit + k < CPU_SETSIZE; k++)
+			if (v & (1 << k))
+				CPU_SET(bit + k, set);
+		bit += 4;
+	}
+}
+
+/* the list of a "name=LIST" kernel parameter, empty set if not given */
+static void audit_cmdline(const char *cmdline, const char *name, cpu_set_t *set)
+{
+	const char *p = cmdline;
+	size_t len = strlen(name);
+
+	CPU_ZERO(set);
+	while ((p = strstr(p, name))) {
+		if ((p == cmdline || isspace((unsigned char)p[-1])) &&
+		    p[len] == '=') {
+			audit_cpulist(p + len + 1, set);
+			return;
+		}
+		p += len;
+	}
+}
+
+static void audit_irqs(struct audit *a)
+{
+	char path[64], buf[256];
+	struct dirent *d;
+	cpu_set_t set;
+	DIR *dir;
+	int i, irq;
+
+	dir = opendir("/proc/irq");
+	if (!dir)
+		return;
+	while ((d = readdir(dir))) {
+		if (!isdigit((unsigned char)d->d_name[0]))
+			continue;
+		irq = atoi(d->d_name);
+		snprintf(path, sizeof(path), "/proc/irq/%d/smp_affinity", irq);
+		if (!audit_read(path, buf, sizeof(buf)))
+			continue;
+		audit_hexmask(buf, &set);
+		for (i = 0; i < a->nr_cpus; i++) {
+			struct cpu_audit *c = &a->cpus[i];
+
+			if (!CPU_ISSET(c->cpu, &set))
+				continue;
+			if (c->nr_irqs < AUDIT_IRQS)
+				c->irqs[c->nr_irqs] = irq;
+			c->nr_irqs++;
+			c->flags |= 1 << AUDIT_IRQ;
+		}
+	}
+	closedir(dir);
+}
+
+/*
+ * Add the /proc/softirqs counts of the audited cpus to their softirqs,
+ * or subtract them if sign is negative.
+ */
+static int audit_softirqs(struct audit *a, int sign)
+{
+	char line[4096], *p, *end;
+	int cols[CPU_SETSIZE];
+	int ncols = 0, row = 0, col, i;
+	uint64_t v;
+	FILE *fp;
+
+	fp = fopen("/proc/softirqs", "r");
+	if (!fp)
+		return -1;
+
+	/* the header names the cpu of each column */
+	if (!fgets(line, sizeof(line), fp)) {
+		fclose(fp);
+		return -1;
+	}
+	for (p = line; (p = strstr(p, "CPU")) && ncols < CPU_SETSIZE; p += 3)
+		cols[ncols++] = atoi(p + 3);
+
+	while (row < AUDIT_SOFTIRQS && fgets(line, sizeof(line), fp)) {
+		p = strchr(line, ':');
+		if (!p)
+			continue;
+		*p++ = '\0';
+		if (sign > 0) {
+			for (end = line; isspace((unsigned char)*end); end++)
+				;
+			snprintf(a->softirq_names[row], AUDIT_NAMELEN, "%.*s",
+				 AUDIT_NAMELEN - 1, end);
+		}
+		for (col = 0; col < ncols; col++) {
+			v = strtoull(p, &end, 10);
+			if (end == p)
+				break;
+			p = end;
+			for (i = 0; i < a->nr_cpus; i++)
+				if (a->cpus[i].cpu == cols[col])
+					a->cpus[i].softirqs[row] += sign > 0 ? v : -v;
+		}
+		row++;
+	}
+	a->nr_softirqs = row;
+	fclose(fp);
+	return 0;
+}
+
+/*
+ * Audit the cpus in set, the softirqs are counted over sample_ms
+ * milliseconds. Returns -1 with errno set on failure.
+ */
+int audit_run(struct audit *a, const cpu_set_t *cpus, int sample_ms)
+{
+	cpu_set_t isolated, nohz_full, rcu_nocbs, workqueue;
+	struct timespec wait = {
+		.tv_sec = sample_ms / 1000,
+		.tv_nsec = (sample_ms % 1000) * 1000000L,
+	};
+	char buf[4096];
+	int cpu, i;
+
+	memset(a, 0, sizeof(*a));
+	a->cpus = calloc(CPU_COUNT(cpus), sizeof(*a->cpus));
+	if (!a->cpus)
+		return -1;
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+		if (CPU_ISSET(cpu, cpus))
+			a->cpus[a->nr_cpus++].cpu = cpu;
+	a->sample_ms = sample_ms;
+
+	CPU_ZERO(&isolated);
+	if (audit_read("/sys/devices/system/cpu/isolated", buf, sizeof(buf)))
+		audit_cpulist(buf, &isolated);
+	CPU_ZERO(&nohz_full);
+	if (audit_read("/sys/devices/system/cpu/nohz_full", buf, sizeof(buf)))
+		audit_cpulist(buf, &nohz_full);
+	/* there is no sysfs file for it, nohz_full cpus are offloaded too */
+	CPU_ZERO(&rcu_nocbs);
+	if (audit_read("/proc/cmdline", buf, sizeof(buf)))
+		audit_cmdline(buf, "rcu_nocbs", &rcu_nocbs);
+	CPU_OR(&rcu_nocbs, &rcu_nocbs, &nohz_full);
+	/* without the file the workqueues may run anywhere */
+	if (audit_read("/sys/devices/virtual/workqueue/cpumask", buf, sizeof(buf)))
+		audit_hexmask(buf, &workqueue);
+	else
+		workqueue = *cpus;
+
+	for (i = 0; i < a->nr_cpus; i++) {
+		struct cpu_audit *c = &a->cpus[i];
+
+		if (!CPU_ISSET(c->cpu, &isolated))
+			c->flags |= 1 << AUDIT_NOT_ISOLATED;
+		if (!CPU_ISSET(c->cpu, &nohz_full))
+			c->flags |= 1 << AUDIT_NO_NOHZ_FULL;
+		if (!CPU_ISSET(c->cpu, &rcu_nocbs))
+			c->flags |= 1 << AUDIT_NO_RCU_NOCBS;
+		if (CPU_ISSET(c->cpu, &workqueue))
+			c->flags |= 1 << AUDIT_WORKQUEUE;
+	}
+
+	audit_irqs(a);
+
+	if (audit_softirqs(a, -1) == 0) {
+		while (clock_nanosleep(CLOCK_MONOTONIC, 0, &wait, &wait) == EINTR)
+			;
+		audit_softirqs(a, 1);
+	}
+	return 0;
+}
+
+void audit_free(struct audit *a)
+{
+	free(a->cpus);
+	memset(a, 0, sizeof(*a));
+}
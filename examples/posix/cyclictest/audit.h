@@ -0,0 +1,58 @@
+/*
+ * audit.h - isolation audit of the measurement cpus
+ *
+ * Before the test starts cyclictest can look at what else is going to
+ * run on the cpus it measures: device interrupts that may be routed to
+ * them, whether they are isolated from the scheduler, the tick, RCU
+ * callbacks and unbound workqueues, and how many softirqs they serve
+ * while the system is otherwise left alone.
+ */
+
+#ifndef __AUDIT_H
+#define __AUDIT_H
+
+#include <sched.h>
+#include <stdint.h>
+
+/* softirq kinds kept, the kernel has 10 */
+#define AUDIT_SOFTIRQS		12
+#define AUDIT_NAMELEN		16
+/* irq numbers kept per cpu for the report */
+#define AUDIT_IRQS		32
+
+/* findings, as bit numbers of cpu_audit.flags */
+enum {
+	AUDIT_NOT_ISOLATED,	/* not in /sys/devices/system/cpu/isolated */
+	AUDIT_NO_NOHZ_FULL,	/* the tick keeps running */
+	AUDIT_NO_RCU_NOCBS,	/* RCU callbacks are invoked here */
+	AUDIT_WORKQUEUE,	/* in the unbound workqueue cpumask */
+	AUDIT_IRQ,		/* device interrupts may be routed here */
+	AUDIT_FLAGS
+};
+
+/* the findings that make --audit=strict refuse to measure */
+#define AUDIT_SEVERE	((1 << AUDIT_NOT_ISOLATED) | (1 << AUDIT_WORKQUEUE) | \
+			 (1 << AUDIT_IRQ))
+
+struct cpu_audit {
+	int cpu;
+	unsigned int flags;
+	int nr_irqs;
+	int irqs[AUDIT_IRQS];	/* the first AUDIT_IRQS of them */
+	uint64_t softirqs[AUDIT_SOFTIRQS];	/* during the sample */
+};
+
+struct audit {
+	int nr_cpus;
+	struct cpu_audit *cpus;
+	int nr_softirqs;
+	char softirq_names[AUDIT_SOFTIRQS][AUDIT_NAMELEN];
+	int sample_ms;
+};
+
+extern const char *audit_flag_names[AUDIT_FLAGS];
+
+int audit_run(struct audit *a, const cpu_set_t *cpus, int sample_ms);
+void audit_free(struct audit *a);
+
+#endif	/* __AUDIT_H */
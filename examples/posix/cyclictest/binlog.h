@@ -0,0 +1,40 @@
+/*
+ * binlog.h - binary sample log written by cyclictest --binlog
+ *
+ * The file starts with a struct binlog_header followed by a stream of
+ * fixed-size struct binlog_record entries in host byte order, each
+ * holding the plain latency so that any record can be decoded on its
+ * own.
+ */
+
+#ifndef __BINLOG_H
+#define __BINLOG_H
+
+#include <stdint.h>
+
+#define BINLOG_MAGIC		"CTBL"
+#define BINLOG_VERSION		2
+
+/* header units */
+#define BINLOG_UNITS_US		0
+#define BINLOG_UNITS_NS		1
+
+struct binlog_header {
+	char magic[4];
+	uint16_t version;
+	uint16_t record_size;
+	uint16_t units;
+	uint16_t nthreads;
+	uint32_t interval;	/* interval of thread 0 in us */
+	uint32_t distance;	/* interval increment per thread in us */
+	uint32_t reserved;
+};
+
+struct binlog_record {
+	uint32_t cycle;		/* low 32 bits of the cycle number */
+	uint16_t thread;
+	uint16_t flags;		/* none defined yet, written as 0 */
+	int32_t value;
+};
+
+#endif	/* __BINLOG_H */
@@ -0,0 +1,220 @@
+/*
+ * cyclictest-decode - turn a cyclictest --binlog file into CSV or a
+ * latency histogram
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+
+#include "binlog.h"
+
+/* Records read from the log per fread() */
+#define READ_RECORDS		65536
+
+struct thread_state {
+	uint64_t cycle;
+	int64_t value;
+	int64_t min;
+	int64_t max;
+	double sum;
+	uint64_t samples;
+	uint64_t overflows;
+	uint64_t *hist;
+};
+
+static int hist_buckets;
+static int hist_width = 1;
+
+static void display_help(int error)
+{
+	printf("Usage:\n"
+	       "cyclictest-decode <options> <binlog>\n\n"
+	       "-b NUM   --buckets=NUM     print a histogram with NUM buckets\n"
+	       "                           instead of the CSV sample list\n"
+	       "-w WIDTH --width=WIDTH     width of one histogram bucket, default=1\n"
+	       "-o FILE  --output=FILE     write to FILE instead of stdout\n"
+	       "-h       --help            this help\n");
+	exit(error ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+static void print_hist(FILE *out, struct thread_state *ts, int nthreads)
+{
+	int i, j;
+
+	fprintf(out, "# latency");
+	for (j = 0; j < nthreads; j++)
+		fprintf(out, ",T%d", j);
+	fprintf(out, "\n");
+
+	for (i = 0; i < hist_buckets; i++) {
+		fprintf(out, "%d", i * hist_width);
+		for (j = 0; j < nthreads; j++)
+			fprintf(out, ",%llu", (unsigned long long)ts[j].hist[i]);
+		fprintf(out, "\n");
+	}
+	fprintf(out, "# overflows");
+	for (j = 0; j < nthreads; j++)
+		fprintf(out, ",%llu", (unsigned long long)ts[j].overflows);
+	fprintf(out, "\n");
+}
+
+static void print_summary(FILE *out, struct thread_state *ts, int nthreads,
+			  const char *units)
+{
+	int j;
+
+	for (j = 0; j < nthreads; j++) {
+		if (!ts[j].samples)
+			continue;
+		fprintf(out, "# T:%2d C:%9llu Min:%8lld Avg:%8lld Max:%8lld (%s)\n",
+			j, (unsigned long long)ts[j].samples,
+			(long long)ts[j].min,
+			(long long)(ts[j].sum / ts[j].samples),
+			(long long)ts[j].max, units);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	struct binlog_header hdr;
+	struct binlog_record *recs;
+	struct thread_state *ts;
+	FILE *in, *out = stdout;
+	size_t n, i;
+	int j;
+
+	for (;;) {
+		static struct option long_options[] = {
+			{"buckets", required_argument, NULL, 'b'},
+			{"width",   required_argument, NULL, 'w'},
+			{"output",  required_argument, NULL, 'o'},
+			{"help",    no_argument,       NULL, 'h'},
+			{NULL, 0, NULL, 0}
+		};
+		int c = getopt_long(argc, argv, "b:w:o:h", long_options, NULL);
+		if (c == -1)
+			break;
+		switch (c) {
+		case 'b':
+			hist_buckets = atoi(optarg); break;
+		case 'w':
+			hist_width = atoi(optarg); break;
+		case 'o':
+			out = fopen(optarg, "w");
+			if (!out) {
+				fprintf(stderr, "unable to open %s: %s\n",
+					optarg, strerror(errno));
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'h':
+			display_help(0); break;
+		default:
+			display_help(1); break;
+		}
+	}
+	if (optind != argc - 1 || hist_buckets < 0 || hist_width < 1)
+		display_help(1);
+
+	in = fopen(argv[optind], "r");
+	if (!in) {
+		fprintf(stderr, "unable to open %s: %s\n", argv[optind],
+			strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	if (fread(&hdr, sizeof(hdr), 1, in) != 1 ||
+	    memcmp(hdr.magic, BINLOG_MAGIC, sizeof(hdr.magic))) {
+		fprintf(stderr, "%s: not a cyclictest binary log\n", argv[optind]);
+		exit(EXIT_FAILURE);
+	}
+	if (hdr.version != BINLOG_VERSION ||
+	    hdr.record_size != sizeof(struct binlog_record)) {
+		fprintf(stderr, "%s: unsupported log version %u\n",
+			argv[optind], hdr.version);
+		exit(EXIT_FAILURE);
+	}
+
+	ts = calloc(hdr.nthreads, sizeof(*ts));
+	recs = malloc(READ_RECORDS * sizeof(*recs));
+	if (!ts || !recs) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	for (j = 0; j < hdr.nthreads; j++) {
+		ts[j].min = INT64_MAX;
+		ts[j].max = INT64_MIN;
+		if (hist_buckets) {
+			ts[j].hist = calloc(hist_buckets, sizeof(uint64_t));
+			if (!ts[j].hist) {
+				fprintf(stderr, "out of memory\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+
+	fprintf(out, "# interval %u us, distance %u us, %u threads\n",
+		hdr.interval, hdr.distance, hdr.nthreads);
+	if (!hist_buckets)
+		fprintf(out, "thread,cycle,latency\n");
+
+	while ((n = fread(recs, sizeof(*recs), READ_RECORDS, in)) > 0) {
+		for (i = 0; i < n; i++) {
+			struct binlog_record *r = &recs[i];
+			struct thread_state *t;
+			uint64_t cycle;
+
+			if (r->thread >= hdr.nthreads) {
+				fprintf(stderr, "corrupt record for thread %u\n",
+					r->thread);
+				exit(EXIT_FAILURE);
+			}
+			t = &ts[r->thread];
+
+			/* extend the 32 bit cycle number */
+			cycle = (t->cycle & ~0xffffffffULL) | r->cycle;
+			if (t->samples && cycle < t->cycle)
+				cycle += 1ULL << 32;
+			t->cycle = cycle;
+
+			t->value = r->value;
+
+			if (t->value < t->min)
+				t->min = t->value;
+			if (t->value > t->max)
+				t->max = t->value;
+			t->sum += t->value;
+			t->samples++;
+
+			if (!hist_buckets) {
+				fprintf(out, "%u,%llu,%lld\n", r->thread,
+					(unsigned long long)cycle,
+					(long long)t->value);
+				continue;
+			}
+			if (t->value < 0 || t->value / hist_width >= hist_buckets)
+				t->overflows++;
+			else
+				t->hist[t->value / hist_width]++;
+		}
+	}
+	fclose(in);
+
+	if (hist_buckets)
+		print_hist(out, ts, hdr.nthreads);
+	print_summary(out, ts, hdr.nthreads,
+		      hdr.units == BINLOG_UNITS_NS ? "ns" : "us");
+
+	if (out != stdout)
+		fclose(out);
+	return EXIT_SUCCESS;
+}
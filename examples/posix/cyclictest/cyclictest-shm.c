@@ -0,0 +1,163 @@
+/*
+ * cyclictest-shm - print the live statistics a running cyclictest
+ * publishes with --shm
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "histogram.h"
+#include "telemetry.h"
+
+/* histogram percentiles printed with -p */
+static const double hist_percentiles[] = { 50.0, 99.0, 99.9, 99.99 };
+
+static int print_percentiles;
+
+static void display_help(int error)
+{
+	printf("Usage:\n"
+	       "cyclictest-shm <options> <name>\n\n"
+	       "-i MS    --interval=MS     print every MS milliseconds until the test\n"
+	       "                           finishes, default is to print once\n"
+	       "-p       --percentiles     add percentiles computed from the histogram\n"
+	       "-h       --help            this help\n");
+	exit(error ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+static const char *state_name(uint32_t state)
+{
+	switch (state) {
+	case TELEMETRY_STARTING: return "starting";
+	case TELEMETRY_RUNNING: return "running";
+	case TELEMETRY_FINISHED: return "finished";
+	}
+	return "unknown";
+}
+
+static int print_slots(const struct telemetry *t, uint64_t *counts)
+{
+	const struct telemetry_header *hdr = t->hdr;
+	struct telemetry_slot slot;
+	struct histogram h;
+	unsigned int i, j;
+
+	printf("# pid %d, %u threads, %s, %s\n", hdr->pid, hdr->nthreads,
+	       hdr->units == TELEMETRY_UNITS_NS ? "ns" : "us",
+	       state_name(__atomic_load_n(&hdr->state, __ATOMIC_ACQUIRE)));
+
+	/* same layout as in cyclictest, only the counts come from the copy */
+	memset(&h, 0, sizeof(h));
+	h.sub_bits = hdr->hist_sub_bits;
+	h.nbuckets = hdr->hist_nbuckets;
+	h.limit = hdr->hist_limit;
+	h.counts = counts;
+
+	for (i = 0; i < hdr->nthreads; i++) {
+		if (telemetry_read(t, i, &slot, counts)) {
+			fprintf(stderr, "thread %u: %s\n", i, strerror(errno));
+			return -1;
+		}
+		printf("T:%2u (%5d) P:%2d I:%u C:%9llu Min:%7lld Act:%5lld "
+		       "Avg:%5lld Max:%8lld\n", i, slot.tid, slot.prio,
+		       slot.interval, (unsigned long long)slot.cycles,
+		       slot.cycles ? (long long)slot.min : 0LL,
+		       (long long)slot.act,
+		       slot.cycles ? (long long)(slot.sum / slot.cycles) : 0LL,
+		       (long long)slot.max);
+
+		if (hdr->flags & TELEMETRY_HAS_QUANTILES) {
+			printf("     Win:%8lld Dev:%8.1f", (long long)slot.winmax,
+			       slot.cycles > 1 ?
+			       sqrt(slot.m2 / (slot.cycles - 1)) : 0.0);
+			for (j = 0; j < TELEMETRY_QUANTILES; j++)
+				printf(" P%g:%8.0f", hdr->quantile[j],
+				       slot.quant[j]);
+			printf("\n");
+		}
+
+		if (print_percentiles && h.nbuckets) {
+			h.overflow = slot.overflow;
+			h.overflow_max = slot.overflow_max;
+			printf("     Hist:");
+			for (j = 0; j < sizeof(hist_percentiles) /
+				     sizeof(hist_percentiles[0]); j++)
+				printf(" P%g:%llu", hist_percentiles[j],
+				       (unsigned long long)
+				       hist_percentile(&h, hist_percentiles[j]));
+			printf(" Overflows:%llu\n",
+			       (unsigned long long)slot.overflow);
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct telemetry t;
+	uint64_t *counts = NULL;
+	int interval = 0;
+
+	for (;;) {
+		static struct option long_options[] = {
+			{"interval",    required_argument, NULL, 'i'},
+			{"percentiles", no_argument,       NULL, 'p'},
+			{"help",        no_argument,       NULL, 'h'},
+			{NULL, 0, NULL, 0}
+		};
+		int c = getopt_long(argc, argv, "i:ph", long_options, NULL);
+		if (c == -1)
+			break;
+		switch (c) {
+		case 'i':
+			interval = atoi(optarg); break;
+		case 'p':
+			print_percentiles = 1; break;
+		case 'h':
+			display_help(0); break;
+		default:
+			display_help(1); break;
+		}
+	}
+	if (optind != argc - 1 || interval < 0)
+		display_help(1);
+
+	if (telemetry_attach(&t, argv[optind])) {
+		fprintf(stderr, "unable to attach to %s: %s\n", argv[optind],
+			strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	if (t.hdr->hist_nbuckets) {
+		counts = malloc(t.hdr->hist_nbuckets * sizeof(*counts));
+		if (!counts) {
+			fprintf(stderr, "out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	for (;;) {
+		if (print_slots(&t, counts))
+			exit(EXIT_FAILURE);
+		if (!interval || __atomic_load_n(&t.hdr->state,
+				__ATOMIC_ACQUIRE) == TELEMETRY_FINISHED)
+			break;
+		fflush(stdout);
+		usleep(interval * 1000);
+	}
+
+	free(counts);
+	telemetry_detach(&t);
+	return EXIT_SUCCESS;
+}
@@ -20,14 +20,17 @@
 #include <fcntl.h>
 #include <getopt.h>
 #include <pthread.h>
+#include <semaphore.h>
 #include <signal.h>
 #include <sched.h>
 #include <string.h>
 #include <time.h>
 #include <errno.h>
 #include <limits.h>
+#include <math.h>
 #include <linux/unistd.h>
 
+#include <poll.h>
 #include <sys/prctl.h>
 #include <sys/stat.h>
 #include <sys/sysinfo.h>
@@ -36,15 +39,43 @@
 #include <sys/resource.h>
 #include <sys/utsname.h>
 #include <sys/mman.h>
+#include <sys/timerfd.h>
+#ifdef __COBALT__
+#include <sys/select.h>
+#else
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+#ifdef __COBALT__
+#include <cobalt/sys/cobalt.h>
+#include <boilerplate/trace.h>
+#endif
 #include "rt_numa.h"
 
 #include "rt-utils.h"
+#include "rt-sched.h"
+#include "binlog.h"
+#include "histogram.h"
+#include "quantile.h"
+#include "telemetry.h"
+#include "tsc.h"
+#include "load.h"
+#include "work.h"
+#include "audit.h"
+#include "irqstat.h"
+#include "perfctr.h"
+#include "numamat.h"
+#include "statsock.h"
 
 #define DEFAULT_INTERVAL 1000
 #define DEFAULT_DISTANCE 500
 
 #define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
 
+#define CACHELINE_SIZE		64
+#define __cacheline_aligned	__attribute__((aligned(CACHELINE_SIZE)))
+
 /* Ugly, but .... */
 #define gettid() syscall(__NR_gettid)
 #define sigev_notify_thread_id _sigev_un._tid
@@ -52,19 +83,77 @@
 #define USEC_PER_SEC		1000000
 #define NSEC_PER_SEC		1000000000
 
-#define HIST_MAX		1000000
+#define HIST_MAX		1000000000
+#define HIST_DIGITS		3
+#define OUTLIERS_MAX		65536
 
 #define MODE_CYCLIC		0
 #define MODE_CLOCK_NANOSLEEP	1
 #define MODE_SYS_ITIMER		2
 #define MODE_SYS_NANOSLEEP	3
 #define MODE_SYS_OFFSET		2
+#define MODE_TIMERFD		4
+#define MODE_DEADLINES		5
+
+/* Max timers one thread waits for with --timerfd */
+#define TIMERFD_MAX		64
+/* Max deadlines one thread serves with --deadlines */
+#define DEADLINES_MAX		1024
 
 #define TIMER_RELTIME		0
 
+/* Default display refresh period in ms */
+#define DEFAULT_REFRESH		10
+/* Display buffer space per status line */
+#define DISPLAY_LINE		256
+/* Clients served at the same time by the stats socket */
+#define STATS_CLIENTS		16
+
 /* Must be power of 2 ! */
 #define VALBUF_SIZE		16384
 
+/* Samples moved out of a ring before the drain thread releases the slots */
+#define DRAIN_BATCH		256
+/* Drain thread polling period in us */
+#define DRAIN_INTERVAL		1000
+
+/* Quantiles estimated by --quantiles, see live_quantiles[] */
+#define NR_QUANTILES		3
+
+/* Window lengths given with --windows, and closed windows kept per length */
+#define WINDOW_LEVELS		3
+#define WINDOW_SLOTS		4096
+#define WINDOW_DIGITS		2
+
+/* Size of the buffer collecting binary log records before each write */
+#define BINLOG_BUFSIZE		(1024 * 1024)
+
+/* --audit softirq sample time in ms */
+#define AUDIT_SAMPLE		250
+
+/* --spikes default snapshot period in ms, spikes kept per thread, sources named */
+#define SPIKE_PERIOD		100
+#define SPIKES			8
+#define SPIKE_TOP		3
+
+/* struct spike missing, counters which could not be read around it */
+#define SPIKE_NO_IRQS		0x1
+#define SPIKE_NO_SOFTIRQS	0x2
+
+/* --recorder default cycles kept per thread, rounded up to a power of two */
+#define FLIGHT_SIZE		4096
+
+/* --numa-matrix default lines followed per cycle and MB per node */
+#define NUMAMAT_LINES		256
+#define NUMAMAT_MB		64
+
+/* Missed period histogram, the last bucket counts that many or more */
+#define MISSED_BUCKETS		16
+
+/* --tsc calibration time in ms and period of the per thread resync in ns */
+#define TSC_CALIBRATE		200
+#define TSC_RESYNC		1000000000LL
+
 #define KVARS			32
 #define KVARNAMELEN		32
 #define KVALUELEN		32
@@ -106,31 +195,217 @@ struct thread_param {
 	unsigned long interval;
 	int cpu;
 	int node;
+	int mem_node;		/* node its blocks were placed on, -1 for none */
+	void *stack;		/* from the arena with --numa */
 	int tnum;
+	int timers;
+	int deadlines;
+	uint64_t dl_runtime;	/* SCHED_DEADLINE parameters in ns */
+	uint64_t dl_deadline;
+	uint64_t dl_period;
+};
+
+/* One sample as seen by the drain thread */
+struct sample {
+	unsigned long cycle;
+	long value;
+};
+
+/* A source of interrupts or softirqs and how often it fired */
+struct spike_source {
+	char name[IRQSTAT_NAMELEN];
+	uint64_t count;
+};
+
+/*
+ * What happened on the cpu of a thread between the two counter
+ * snapshots around one of its new maxima.
+ */
+struct spike {
+	unsigned long cycle;
+	long value;
+	int breach;		/* it hit the -b threshold */
+	int missing;		/* SPIKE_NO_* */
+	int64_t span;		/* ns between the snapshots */
+	uint64_t irqs;
+	uint64_t softirqs;
+	long nvcsw;		/* context switches of the thread */
+	long nivcsw;
+	struct spike_source irq_top[SPIKE_TOP];
+	struct spike_source softirq_top[SPIKE_TOP];
+};
+
+/* One cycle in the --recorder ring, two to a cache line */
+struct flight {
+	int64_t expected;	/* ns, timer clock */
+	int64_t wakeup;
+	int64_t diff;		/* as in the statistics */
+	uint32_t ctxsw;		/* last sampled context switch count */
+	int16_t cpu;		/* -1 if not known */
+	uint16_t overruns;	/* periods missed at this wakeup */
+};
+
+/*
+ * Single-producer/single-consumer ring of verbose and binary log samples.
+ * head is only written by the timer thread, tail only by the drain
+ * thread, each on its own cache line. A sample which does not fit is
+ * dropped and counted in overruns instead of overwriting data that was
+ * not yet drained.
+ */
+struct sample_ring {
+	unsigned long head;
+	unsigned long overruns;
+	struct sample *buf;
+	unsigned long tail __cacheline_aligned;
+};
+
+/* Rollup of one closed --windows window */
+struct window_stat {
+	unsigned long index;	/* window number since the thread started */
+	unsigned long samples;
+	long min;
+	long max;
+	double avg;
+	long p99;
+};
+
+/*
+ * The window currently filled by the timer thread for one window
+ * length, plus the ring of the last WINDOW_SLOTS closed ones. The
+ * histogram is double buffered: a closed window's buffer is handed to
+ * the drain thread through retired, which computes the p99 and clears
+ * the buffer while the timer thread fills the other one.
+ */
+struct window_level {
+	int64_t end;		/* in ns */
+	unsigned long index;
+	unsigned long samples;
+	long min;
+	long max;
+	double sum;
+	unsigned int cur;	/* buffer of the open window */
+	struct histogram hist[2];
+	struct window_stat *retired;	/* waiting for its p99, or NULL */
+	unsigned long closed;
+	struct window_stat *ring;
+};
+
+/*
+ * Timers of one thread in MODE_TIMERFD. The timers share the interval
+ * and are spread evenly over it, the ones found expired by one wait
+ * are handled one after the other like an event loop would.
+ */
+struct timerfd_set {
+	int count;
+	int fd[TIMERFD_MAX];
+	int64_t next[TIMERFD_MAX];	/* deadline of each timer in ns */
+	int ready[TIMERFD_MAX];
+	int nready;
+	uint64_t expired;		/* expirations read for the current timer */
+#ifndef __COBALT__
+	int epfd;
+#endif
+};
+
+/*
+ * One periodic deadline of a thread in MODE_DEADLINES. The thread keeps
+ * them in a binary min-heap ordered by next and always sleeps until the
+ * earliest one, the latency of each deadline is accounted separately.
+ */
+struct deadline {
+	int64_t next;		/* in ns */
+	int64_t period;		/* in ns */
+	unsigned long cycles;
+	long min;
+	long max;
+	double sum;
 };
 
-/* Struct for statistics */
+/*
+ * Struct for statistics
+ *
+ * The leading cache lines are written by the timer thread on every cycle,
+ * the running statistics up to quant are published to the reporters
+ * through seq,
+ * see stat_snapshot(). The ring tail and everything after it belongs
+ * to the drain thread, the rest is only touched at thread start and
+ * exit. Blocks come from threadalloc() and are padded to whole cache
+ * lines, so neighbouring threads never share a line either.
+ */
 struct thread_stat {
+	unsigned int seq;
 	unsigned long cycles;
-	unsigned long cyclesread;
 	long min;
 	long max;
 	long act;
 	double avg;
-	long *values;
-	long *hist_array;
+	struct histogram hist;
+	long num_outliers;
 	long *outliers;
-	pthread_t thread;
-	int threadstarted;
-	int tid;
+	double mean;
+	double m2;
+	long winmax;
+	unsigned int window;
+	struct p2_quantile quant[NR_QUANTILES];
+	struct window_level *windows;
+	struct deadline *deadlines;
+	struct deadline **dlheap;
+	struct histogram exec_hist;
+	struct histogram resp_hist;
+	long exec_min;
+	long exec_max;
+	double exec_sum;
+	long resp_max;
+	unsigned long misses;
+	unsigned long missed;
+	unsigned long missed_cycles;
+	unsigned long missed_hist[MISSED_BUCKETS];
+	unsigned int spike_seq;		/* odd while the two below change */
+	unsigned long spike_cycle;	/* latest new max, for the spike thread */
+	long spike_value;
+	int spike_breach;
+	int spike_pending;
+	struct spike *spikes;		/* the last SPIKES of them */
+	unsigned long nr_spikes;
+	struct histogram perf_hist;	/* samples per latency bucket */
+	uint64_t *perf_sum;		/* counts per bucket, overflows last */
+	unsigned int perf_events;	/* bit mask of the counters opened */
+	int perf_kernel;
+	struct flight *flight;		/* the last flight_size cycles */
+	struct numamat_cell *numa_cells;	/* cpu node x memory node */
+	void **numa_pos;		/* where the walk is in each set */
+	unsigned long flight_head;	/* cycles recorded */
+	uint32_t flight_ctxsw;		/* sampled by the drain thread */
+	struct telemetry_slot *shm;
+	struct sample_ring ring __cacheline_aligned;
 	long reduce;
 	long redmax;
 	long cycleofmax;
-	long hist_overflow;
-	long num_outliers;
+	unsigned long tsc_syncs;
+	int64_t tsc_offset_max;
+	int64_t tsc_offset_sum;
+	int64_t start_ns;		/* when it left the start barrier */
+	pthread_t thread __cacheline_aligned;
+	int threadstarted;
+	int tid;
+} __cacheline_aligned;
+
+/* Consistent copy of the published part of struct thread_stat */
+struct stat_snapshot {
+	unsigned long cycles;
+	long min;
+	long max;
+	long act;
+	double avg;
+	double stddev;
+	long winmax;
+	double quant[NR_QUANTILES];
 };
 
+static const double live_quantiles[NR_QUANTILES] = { 99.0, 99.9, 99.99 };
+
 static int shutdown;
+static volatile sig_atomic_t status_requested;
 static int tracelimit = 0;
 static int notrace = 0;
 static int ftrace = 0;
@@ -141,6 +416,24 @@ static int lockall = 0;
 static int tracetype = NOTRACE;
 static int histogram = 0;
 static int histofall = 0;
+static int hist_digits = HIST_DIGITS;
+static int hist_outliers;
+static int quantiles = 0;
+static int nr_windows = 0;
+static int window_secs[WINDOW_LEVELS];
+static char windowpath[MAX_PATH];
+static int window_csv = 0;
+static char jsonpath[MAX_PATH];
+static char shmname[NAME_MAX];
+static struct telemetry_header *shm_hdr;
+static size_t shm_size;
+
+/* Facts about the system collected for the --json report */
+static int hrtimers_available;
+static uint64_t clock_res_measured;
+static char affinity_string[MAX_PATH];
+/* bumped by the display loop to start a new window max */
+static unsigned int stat_window __cacheline_aligned;
 static int duration = 0;
 static int use_nsecs = 0;
 static int refresh_on_max;
@@ -148,21 +441,58 @@ static int force_sched_other;
 static int priospread = 0;
 static int check_clock_resolution;
 static int ct_debug;
-static int use_fifo = 0;
-static pthread_t fifo_threadid;
+static int use_tsc;
+static struct tsc_clock tsc_calib;
+static uint64_t tsc_read_cost;
+static uint64_t clock_read_cost;
+static struct work_spec work_spec;
+static int work_cold;
+static int work_deadline;
+static int use_perf;
+static unsigned long flight_size;
+static unsigned long numamat_lines;
+static size_t numamat_bytes = (size_t)NUMAMAT_MB << 20;
+static int numamat_nodes;
+static struct numamat_set *numamat_sets;
+static int *numamat_walk;		/* the online nodes, in walk order */
+static int numamat_walk_nodes;
+static int numamat_cpu_node[CPU_SETSIZE];
+static int use_statsock = 0;
+static pthread_t statsock_threadid;
+static int statsock_started;
+static pthread_t drain_threadid;
+static int drain_started;
+static int drain_stop;
+static int spike_period;
+static pthread_t spike_threadid;
+static int spike_started;
+static int spike_stop;
+static int use_binlog = 0;
+static char binlogpath[MAX_PATH];
+static int binlog_fd = -1;
+static char *binlog_buf;
+static size_t binlog_len;
 static int aligned = 0;
 static int secaligned = 0;
 static int offset = 0;
 static int laptop = 0;
 
-static pthread_cond_t refresh_on_max_cond = PTHREAD_COND_INITIALIZER;
-static pthread_mutex_t refresh_on_max_lock = PTHREAD_MUTEX_INITIALIZER;
+static int refresh_period = DEFAULT_REFRESH;
+
+/*
+ * Wakes up the display loop early: on a new max with -M, when a timer
+ * thread exits and on shutdown. refresh_pending keeps the timer threads
+ * from posting more than once per refresh.
+ */
+static sem_t refresh_sem;
+static int refresh_pending;
 
 static pthread_mutex_t break_thread_id_lock = PTHREAD_MUTEX_INITIALIZER;
 static pid_t break_thread_id = 0;
 static uint64_t break_thread_value = 0;
 
-static struct timespec globalt;
+/* Common start of the threads with -A and --secaligned, see start_release() */
+static int64_t start_epoch;
 
 /* Backup of kernel variables that we modify */
 static struct kvars {
@@ -173,7 +503,7 @@ static struct kvars {
 static char *procfileprefix = "/proc/sys/kernel/";
 static char *fileprefix;
 static char tracer[MAX_PATH];
-static char fifopath[MAX_PATH];
+static char statsock_path[MAX_PATH];
 static char **traceptr;
 static int traceopt_count;
 static int traceopt_size;
@@ -250,6 +580,56 @@ static char traceroptions[MAX_PATH];
 static int trace_fd     = -1;
 static int tracemark_fd = -1;
 
+/*
+ * Control files are opened on first use and kept open for the run.
+ * Sysctls only take writes at offset 0, so the file is rewound before
+ * each access; that fails harmlessly on the tracefs files that can not
+ * seek.
+ */
+#define KVARFDS			32
+
+static struct kvarfd {
+	char path[128];
+	int mode;
+	int fd;
+} kvarfds[KVARFDS];
+static int nr_kvarfds;
+
+static int kernvar_open(const char *filename, int mode)
+{
+	struct kvarfd *k;
+	int i, fd;
+
+	for (i = 0; i < nr_kvarfds; i++)
+		if (kvarfds[i].mode == mode && !strcmp(kvarfds[i].path, filename))
+			return kvarfds[i].fd;
+
+	fd = open(filename, mode);
+	if (fd < 0 || nr_kvarfds == KVARFDS)
+		return fd;
+	k = &kvarfds[nr_kvarfds++];
+	strcpy(k->path, filename);
+	k->mode = mode;
+	k->fd = fd;
+	return fd;
+}
+
+static int kernvar_cached(int fd)
+{
+	int i;
+
+	for (i = 0; i < nr_kvarfds; i++)
+		if (kvarfds[i].fd == fd)
+			return 1;
+	return 0;
+}
+
+static void kernvar_close(void)
+{
+	while (nr_kvarfds)
+		close(kvarfds[--nr_kvarfds].fd);
+}
+
 static int kernvar(int mode, const char *name, char *value, size_t sizeofvalue)
 {
 	char filename[128];
@@ -265,8 +645,9 @@ static int kernvar(int mode, const char *name, char *value, size_t sizeofvalue)
 	memcpy(filename, fileprefix, len_prefix);
 	memcpy(filename + len_prefix, name, len_name + 1);
 
-	path = open(filename, mode);
+	path = kernvar_open(filename, mode);
 	if (path >= 0) {
+		lseek(path, 0, SEEK_SET);
 		if (mode == O_RDONLY) {
 			int got;
 			if ((got = read(path, value, sizeofvalue)) > 0) {
@@ -277,7 +658,8 @@ static int kernvar(int mode, const char *name, char *value, size_t sizeofvalue)
 			if (write(path, value, sizeofvalue) == sizeofvalue)
 				retval = 0;
 		}
-		close(path);
+		if (!kernvar_cached(path))
+			close(path);
 	}
 	return retval;
 }
@@ -334,18 +716,35 @@ static inline void tsnorm(struct timespec *ts)
 	}
 }
 
-static inline int tsgreater(struct timespec *a, struct timespec *b)
+/*
+ * The timer thread keeps its deadlines as 64 bit nanoseconds and only
+ * converts at the clock_gettime()/clock_nanosleep() boundary.
+ */
+static inline int64_t ts_to_ns(const struct timespec *ts)
 {
-	return ((a->tv_sec > b->tv_sec) ||
-		(a->tv_sec == b->tv_sec && a->tv_nsec > b->tv_nsec));
+	return (int64_t)ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec;
 }
 
-static inline int64_t calcdiff(struct timespec t1, struct timespec t2)
+static inline void ns_to_ts(int64_t ns, struct timespec *ts)
 {
-	int64_t diff;
-	diff = USEC_PER_SEC * (long long)((int) t1.tv_sec - (int) t2.tv_sec);
-	diff += ((int) t1.tv_nsec - (int) t2.tv_nsec) / 1000;
-	return diff;
+	ts->tv_sec = ns / NSEC_PER_SEC;
+	ts->tv_nsec = ns % NSEC_PER_SEC;
+}
+
+/* Timestamp of the thread's clock, taken from the cycle counter with --tsc */
+static inline int thread_clock(clockid_t clock, struct tsc_clock *tsc,
+			       int64_t *ns)
+{
+	struct timespec now;
+	int ret;
+
+	if (use_tsc) {
+		*ns = tsc_to_ns(tsc, tsc_read());
+		return 0;
+	}
+	ret = clock_gettime(clock, &now);
+	*ns = ts_to_ns(&now);
+	return ret;
 }
 
 static inline int64_t calcdiff_ns(struct timespec t1, struct timespec t2)
@@ -387,25 +786,6 @@ static int trace_file_exists(char *name)
 #define TRACEBUFSIZ 1024
 static __thread char tracebuf[TRACEBUFSIZ];
 
-static void tracemark(char *fmt, ...) __attribute__((format(printf, 1, 2)));
-static void tracemark(char *fmt, ...)
-{
-	va_list ap;
-	int len;
-
-	/* bail out if we're not tracing */
-	/* or if the kernel doesn't support trace_mark */
-	if (tracemark_fd < 0)
-		return;
-
-	va_start(ap, fmt);
-	len = vsnprintf(tracebuf, TRACEBUFSIZ, fmt, ap);
-	va_end(ap);
-	write_check(tracemark_fd, tracebuf, len);
-}
-
-
-
 void tracing(int on)
 {
 	if (on) {
@@ -431,6 +811,58 @@ void tracing(int on)
 	}
 }
 
+/*
+ * The threshold stop is a single write to trace_marker: the print
+ * trigger armed in setup_tracer() turns tracing off on that very event,
+ * before anything else gets into the ring buffer. The text up to the
+ * latency is formatted in advance. Without the trigger tracing_on,
+ * which is open already, is written right after.
+ */
+#define TRACESTOP		"hit latency threshold ("
+#define TRACESTOP_TRIGGER	"traceoff if buf ~ \"" TRACESTOP "*\""
+
+static char tracestop_tail[32];		/* " > USEC)" */
+static int tracestop_len;
+static int tracestop_armed;
+
+static void tracestop(unsigned long long diff)
+{
+	char digits[20], *p = digits + sizeof(digits);
+	int len = sizeof(TRACESTOP) - 1;
+
+	do
+		*--p = '0' + diff % 10;
+	while (diff /= 10);
+
+	memcpy(tracebuf, TRACESTOP, len);
+	memcpy(tracebuf + len, p, digits + sizeof(digits) - p);
+	len += digits + sizeof(digits) - p;
+	memcpy(tracebuf + len, tracestop_tail, tracestop_len);
+	len += tracestop_len;
+
+	if (tracemark_fd >= 0)
+		write_check(tracemark_fd, tracebuf, len);
+	if (!tracestop_armed || tracemark_fd < 0)
+		tracing(0);
+}
+
+/*
+ * --tracemark-raw: one binary record per cycle in trace_marker_raw. The
+ * id of the record is TRACEMARK_RAW_ID plus the thread number, so the
+ * threads can be told apart without decoding the payload.
+ */
+#define TRACEMARK_RAW_ID	0x63740000	/* "ct" */
+
+struct rawmark {
+	uint32_t id;
+	uint32_t cpu;
+	uint64_t cycle;
+	int64_t latency;	/* ns */
+};
+
+static int tracemark_raw;
+static char tracemark_raw_path[MAX_PATH];
+
 static int settracer(char *tracer)
 {
 	if (valid_tracer(tracer)) {
@@ -576,6 +1008,15 @@ static void setup_tracer(void)
 				warn("unable to open trace_marker file: %s\n", path);
 		}
 
+		/* let the threshold marker itself stop the trace */
+		snprintf(tracestop_tail, sizeof(tracestop_tail), " > %d)",
+			 tracelimit);
+		tracestop_len = strlen(tracestop_tail);
+		if (tracemark_fd >= 0 &&
+		    !kernvar(O_WRONLY, "events/ftrace/print/trigger",
+			     TRACESTOP_TRIGGER, strlen(TRACESTOP_TRIGGER)))
+			tracestop_armed = 1;
+
 	} else {
 		setkernvar("trace_all_cpus", "1");
 		setkernvar("trace_freerunning", "1");
@@ -701,167 +1142,831 @@ try_again:
 	return err;
 }
 
-/* Work around lack of barriers in oldish uClibc-based toolchains. */
+/*
+ * Start barrier of the measurement threads with -A and --secaligned.
+ * Sense reversing: the last thread to arrive resets the count and flips
+ * the sense, the others wait for the flip. They spin for a while first,
+ * so that with hundreds of threads the release is one store seen by all
+ * of them rather than a broadcast wakeup waking them one after the
+ * other, then sleep on the futex of the sense. On Cobalt a futex would
+ * switch the threads to secondary mode, there they poll with short
+ * sleeps instead.
+ */
+#define BARRIER_SPINS		(1 << 16)
+#define BARRIER_POLL_NS		10000
 
 static struct thread_barrier {
-	pthread_mutex_t lock;
-	pthread_cond_t wait;
 	unsigned int count;
-} align_barr, globalt_barr;
+	unsigned int total;
+	int sense;
+} start_barr;
 
-static inline
-void barrier_init(struct thread_barrier *__restrict barrier,
-		 unsigned int count)
+static __thread int barrier_sense;
+
+static inline void barrier_relax(void)
 {
-	pthread_mutex_init(&barrier->lock, NULL);
-	pthread_cond_init(&barrier->wait, NULL);
-	barrier->count = count;
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+	__asm__ __volatile__("yield" ::: "memory");
+#else
+	__asm__ __volatile__("" ::: "memory");
+#endif
 }
 
-static inline void barrier_destroy(struct thread_barrier *barrier)
+static void barrier_init(struct thread_barrier *barrier, unsigned int count)
 {
-	pthread_mutex_destroy(&barrier->lock);
-	pthread_cond_destroy(&barrier->wait);
+	barrier->count = barrier->total = count;
+	barrier->sense = 0;
 }
 
-static inline void barrier_wait(struct thread_barrier *barrier)
+/*
+ * Wait for all threads. The last one to arrive runs release() before
+ * letting the others go, what it stores there is visible to all of them
+ * once they return.
+ */
+static void barrier_wait(struct thread_barrier *barrier,
+			 void (*release)(void *arg), void *arg)
 {
-	pthread_mutex_lock(&barrier->lock);
+	int sense = barrier_sense = !barrier_sense;
+	unsigned int spins;
+
+	if (__atomic_sub_fetch(&barrier->count, 1, __ATOMIC_ACQ_REL) == 0) {
+		if (release)
+			release(arg);
+		barrier->count = barrier->total;
+		__atomic_store_n(&barrier->sense, sense, __ATOMIC_RELEASE);
+#ifndef __COBALT__
+		syscall(SYS_futex, &barrier->sense, FUTEX_WAKE_PRIVATE, INT_MAX,
+			NULL, NULL, 0);
+#endif
+		return;
+	}
 
-	if (barrier->count > 0) {
-		barrier->count--;
-		pthread_cond_broadcast(&barrier->wait);
-		while (barrier->count > 0)
-			pthread_cond_wait(&barrier->wait, &barrier->lock);
+	for (spins = 0; spins < BARRIER_SPINS; spins++) {
+		if (__atomic_load_n(&barrier->sense, __ATOMIC_ACQUIRE) == sense)
+			return;
+		barrier_relax();
 	}
+	while (__atomic_load_n(&barrier->sense, __ATOMIC_ACQUIRE) != sense) {
+#ifdef __COBALT__
+		struct timespec poll = { 0, BARRIER_POLL_NS };
 
-	pthread_mutex_unlock(&barrier->lock);
+		clock_nanosleep(CLOCK_MONOTONIC, 0, &poll, NULL);
+#else
+		syscall(SYS_futex, &barrier->sense, FUTEX_WAIT_PRIVATE, !sense,
+			NULL, NULL, 0);
+#endif
+	}
 }
 
 /*
- * timer thread
- *
- * Modes:
- * - clock_nanosleep based
- * - cyclic timer based
- *
- * Clock:
- * - CLOCK_MONOTONIC
- * - CLOCK_REALTIME
- *
+ * Seqlock write side around the per-cycle statistics update. The timer
+ * thread is the only writer, so it never waits; readers retry instead.
  */
-void *timerthread(void *param)
+static inline void stat_write_begin(struct thread_stat *stat)
 {
-	struct thread_param *par = param;
-	struct sched_param schedp;
-	struct sigevent sigev;
-	sigset_t sigset;
-	timer_t timer;
-	struct timespec now, next, interval, stop;
-	struct itimerval itimer;
-	struct itimerspec tspec;
-	struct thread_stat *stat = par->stats;
-	int stopped = 0;
-	cpu_set_t mask;
-	pthread_t thread;
-
-	/* if we're running in numa mode, set our memory node */
-	if (par->node != -1)
-		rt_numa_set_numa_run_on_node(par->node, par->cpu);
-
-	if (par->cpu != -1) {
-		CPU_ZERO(&mask);
-		CPU_SET(par->cpu, &mask);
-		thread = pthread_self();
-		if(pthread_setaffinity_np(thread, sizeof(mask), &mask) == -1)
-			warn("Could not set CPU affinity to CPU #%d\n", par->cpu);
-	}
-
-	interval.tv_sec = par->interval / USEC_PER_SEC;
-	interval.tv_nsec = (par->interval % USEC_PER_SEC) * 1000;
+	__atomic_store_n(&stat->seq, stat->seq + 1, __ATOMIC_RELAXED);
+	if (stat->shm)
+		__atomic_store_n(&stat->shm->seq, stat->seq, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
 
-	stat->tid = gettid();
+static inline void stat_write_end(struct thread_stat *stat)
+{
+	__atomic_store_n(&stat->seq, stat->seq + 1, __ATOMIC_RELEASE);
+	if (stat->shm)
+		__atomic_store_n(&stat->shm->seq, stat->seq, __ATOMIC_RELEASE);
+}
 
-	sigemptyset(&sigset);
-	sigaddset(&sigset, par->signal);
-	sigprocmask(SIG_BLOCK, &sigset, NULL);
+/*
+ * Mirror the statistics into the --shm slot, inside the stat write
+ * section. The histogram counts live in the slot already.
+ */
+static inline void telemetry_publish(struct thread_stat *stat)
+{
+	struct telemetry_slot *slot = stat->shm;
+	int i;
 
-	if (par->mode == MODE_CYCLIC) {
-#ifndef USE_MUSL
-		sigev.sigev_notify = SIGEV_THREAD_ID | SIGEV_SIGNAL;
-		sigev.sigev_signo = par->signal;
-		sigev.sigev_notify_thread_id = stat->tid;
-#endif
-		timer_create(par->clock, &sigev, &timer);
-		tspec.it_interval = interval;
+	slot->cycles = stat->cycles;
+	slot->min = stat->min;
+	slot->max = stat->max;
+	slot->act = stat->act;
+	slot->sum = stat->avg;
+	if (quantiles) {
+		slot->winmax = stat->winmax;
+		slot->m2 = stat->m2;
+		for (i = 0; i < NR_QUANTILES; i++)
+			slot->quant[i] = p2_value(&stat->quant[i]);
 	}
+	slot->overflow = stat->hist.overflow;
+	slot->overflow_max = stat->hist.overflow_max;
+}
 
-	memset(&schedp, 0, sizeof(schedp));
-	schedp.sched_priority = par->prio;
-	if (pthread_setschedparam(pthread_self(), par->policy, &schedp))
-		fatal("timerthread%d: failed to set priority to %d\n", par->cpu, par->prio);
+static void stat_snapshot(struct thread_stat *stat, struct stat_snapshot *snap)
+{
+	unsigned int seq;
+	double m2 = 0.0;
+	int i;
 
-	/* Get current time */
-	if (aligned || secaligned) {
-		barrier_wait(&globalt_barr);
-		if (par->tnum == 0) {
-			clock_gettime(par->clock, &globalt);
-			if (secaligned) {
-				/* Ensure that the thread start timestamp is not
-				   in the past */
-				if (globalt.tv_nsec > 900000000)
-					globalt.tv_sec += 2;
-				else
-					globalt.tv_sec++;
-				globalt.tv_nsec = 0;
-			}
+	memset(snap, 0, sizeof(*snap));
+	for (;;) {
+		seq = __atomic_load_n(&stat->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1) {
+			/* the writer may be preempted on our CPU */
+			sched_yield();
+			continue;
 		}
-		barrier_wait(&align_barr);
-		now = globalt;
-		if(offset) {
-			if (aligned)
-				now.tv_nsec += offset * par->tnum;
-			else
-				now.tv_nsec += offset;
-			tsnorm(&now);
+		snap->cycles = stat->cycles;
+		snap->min = stat->min;
+		snap->max = stat->max;
+		snap->act = stat->act;
+		snap->avg = stat->avg;
+		if (quantiles) {
+			m2 = stat->m2;
+			snap->winmax = stat->winmax;
+			for (i = 0; i < NR_QUANTILES; i++)
+				snap->quant[i] = p2_value(&stat->quant[i]);
 		}
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&stat->seq, __ATOMIC_RELAXED) == seq)
+			break;
 	}
-	else
-		clock_gettime(par->clock, &now);
+	if (quantiles)
+		snap->stddev = snap->cycles > 1 ?
+			sqrt(m2 / (snap->cycles - 1)) : 0.0;
+}
+
+/*
+ * Welford variance, P-square quantiles and the max of the current
+ * display window, constant cost per sample. Called inside the stat
+ * write section.
+ */
+static inline void stat_quantiles(struct thread_stat *stat, long diff)
+{
+	unsigned int window = __atomic_load_n(&stat_window, __ATOMIC_RELAXED);
+	double delta = diff - stat->mean;
+	int i;
+
+	stat->mean += delta / stat->cycles;
+	stat->m2 += delta * (diff - stat->mean);
+	for (i = 0; i < NR_QUANTILES; i++)
+		p2_add(&stat->quant[i], diff);
+
+	if (stat->window != window) {
+		stat->window = window;
+		stat->winmax = diff;
+	} else if (diff > stat->winmax)
+		stat->winmax = diff;
+}
+
+static void window_clear(struct histogram *h)
+{
+	h->overflow = 0;
+	h->overflow_max = 0;
+	h->early = 0;
+	memset(h->counts, 0, h->nbuckets * sizeof(*h->counts));
+}
+
+static void window_reset(struct window_level *w)
+{
+	w->samples = 0;
+	w->min = LONG_MAX;
+	w->max = LONG_MIN;
+	w->sum = 0.0;
+}
+
+/* p99 of a window, no higher than its max */
+static long window_p99(struct histogram *h, long max)
+{
+	long p99 = hist_percentile(h, 99.0);
 
-	next = now;
-	next.tv_sec += interval.tv_sec;
-	next.tv_nsec += interval.tv_nsec;
-	tsnorm(&next);
+	return p99 > max ? max : p99;
+}
 
-	memset(&stop, 0, sizeof(stop)); /* grrr */
+static void window_start(struct thread_stat *stat, int64_t now)
+{
+	int i;
 
-	if (duration) {
-		stop = now;
-		stop.tv_sec += duration;
+	for (i = 0; i < nr_windows; i++) {
+		struct window_level *w = &stat->windows[i];
+
+		w->end = now + (int64_t)window_secs[i] * NSEC_PER_SEC;
+		w->index = 0;
+		w->closed = 0;
+		w->cur = 0;
+		w->retired = NULL;
+		window_reset(w);
+		window_clear(&w->hist[0]);
+		window_clear(&w->hist[1]);
 	}
-	if (par->mode == MODE_CYCLIC) {
-		if (par->timermode == TIMER_ABSTIME)
-			tspec.it_value = next;
-		else {
-			tspec.it_value = interval;
+}
+
+/*
+ * Account one sample to every window length, rolling the current window
+ * into the ring once now has passed its end. The histogram scan and
+ * clear of a closed window are left to window_drain(), so unless the
+ * drain thread is a whole window behind the cost per sample is constant.
+ */
+static void window_record(struct thread_stat *stat, int64_t now, long diff)
+{
+	int i;
+
+	for (i = 0; i < nr_windows; i++) {
+		struct window_level *w = &stat->windows[i];
+
+		if (w->end <= now) {
+			int64_t len = (int64_t)window_secs[i] * NSEC_PER_SEC;
+			int64_t skip = (now - w->end) / len + 1;
+
+			if (w->samples) {
+				struct window_stat *ws;
+
+				ws = &w->ring[w->closed++ % WINDOW_SLOTS];
+				ws->index = w->index;
+				ws->samples = w->samples;
+				ws->min = w->min;
+				ws->max = w->max;
+				ws->avg = w->sum / w->samples;
+				if (!__atomic_load_n(&w->retired, __ATOMIC_ACQUIRE)) {
+					w->cur ^= 1;
+					__atomic_store_n(&w->retired, ws,
+							 __ATOMIC_RELEASE);
+				} else {
+					/* the other buffer is still busy */
+					ws->p99 = window_p99(&w->hist[w->cur],
+							     w->max);
+					window_clear(&w->hist[w->cur]);
+				}
+				window_reset(w);
+			}
+			/* windows without samples are skipped in one go */
+			w->end += skip * len;
+			w->index += skip;
 		}
-		timer_settime(timer, par->timermode, &tspec, NULL);
-	}
 
-	if (par->mode == MODE_SYS_ITIMER) {
-		itimer.it_interval.tv_sec = interval.tv_sec;
-		itimer.it_interval.tv_usec = interval.tv_nsec / 1000;
-		itimer.it_value = itimer.it_interval;
-		setitimer (ITIMER_REAL, &itimer, NULL);
+		w->samples++;
+		w->sum += diff;
+		if (diff < w->min)
+			w->min = diff;
+		if (diff > w->max)
+			w->max = diff;
+		hist_record(&w->hist[w->cur], diff);
 	}
+}
 
-	stat->threadstarted++;
+/* Finish the window the timer thread has closed last, if any */
+static void window_drain(struct window_level *w)
+{
+	struct window_stat *ws = __atomic_load_n(&w->retired, __ATOMIC_ACQUIRE);
+	struct histogram *h;
 
-	while (!shutdown) {
+	if (!ws)
+		return;
+	h = &w->hist[w->cur ^ 1];
+	ws->p99 = window_p99(h, ws->max);
+	window_clear(h);
+	__atomic_store_n(&w->retired, NULL, __ATOMIC_RELEASE);
+}
 
-		uint64_t diff;
-		int sigs, ret;
+/*
+ * Queue a sample for the drain thread. Never blocks and
+ * never overwrites samples which have not been drained yet.
+ */
+static inline void ring_push(struct sample_ring *ring, int bufmsk,
+			     unsigned long cycle, long value)
+{
+	unsigned long head = ring->head;
+	struct sample *s;
+
+	if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) > bufmsk) {
+		ring->overruns++;
+		return;
+	}
+	s = &ring->buf[head & bufmsk];
+	s->cycle = cycle;
+	s->value = value;
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * timer thread
+ *
+ * Modes:
+ * - clock_nanosleep based
+ * - cyclic timer based
+ *
+ * Clock:
+ * - CLOCK_MONOTONIC
+ * - CLOCK_REALTIME
+ *
+ */
+/*
+ * Create the --timerfd timers of a thread, the first one expires at
+ * first, the others follow at equal distances within the interval.
+ */
+static int timerfd_start(struct timerfd_set *t, int clock, int count,
+			 int64_t first, int64_t interval)
+{
+	struct itimerspec its;
+	int k;
+
+	memset(t, 0, sizeof(*t));
+#ifndef __COBALT__
+	t->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (t->epfd < 0)
+		return -1;
+#endif
+	ns_to_ts(interval, &its.it_interval);
+	for (k = 0; k < count; k++) {
+		t->fd[k] = timerfd_create(clock, TFD_NONBLOCK|TFD_CLOEXEC);
+		if (t->fd[k] < 0)
+			return -1;
+		t->count++;
+#ifndef __COBALT__
+		{
+			struct epoll_event ev = {
+				.events = EPOLLIN,
+				.data.u32 = k,
+			};
+
+			if (epoll_ctl(t->epfd, EPOLL_CTL_ADD, t->fd[k], &ev))
+				return -1;
+		}
+#endif
+		t->next[k] = first + interval * k / count;
+		ns_to_ts(t->next[k], &its.it_value);
+		if (timerfd_settime(t->fd[k], TFD_TIMER_ABSTIME, &its, NULL))
+			return -1;
+	}
+	return 0;
+}
+
+static void timerfd_stop(struct timerfd_set *t)
+{
+	int k;
+
+	for (k = 0; k < t->count; k++)
+		close(t->fd[k]);
+#ifndef __COBALT__
+	if (t->epfd > 0)
+		close(t->epfd);
+#endif
+	t->count = 0;
+}
+
+/*
+ * Return the next expired timer, waiting for one if the last wait
+ * found no others. Cobalt has no epoll, but its select() handles its
+ * timerfds in primary mode.
+ */
+static int timerfd_next(struct timerfd_set *t)
+{
+	int k, n;
+
+	for (;;) {
+		while (!t->nready) {
+#ifdef __COBALT__
+			fd_set fds;
+			int maxfd = 0;
+
+			FD_ZERO(&fds);
+			for (k = 0; k < t->count; k++) {
+				FD_SET(t->fd[k], &fds);
+				if (t->fd[k] > maxfd)
+					maxfd = t->fd[k];
+			}
+			n = select(maxfd + 1, &fds, NULL, NULL, NULL);
+			if (n < 0)
+				return -1;
+			for (k = 0; k < t->count; k++)
+				if (FD_ISSET(t->fd[k], &fds))
+					t->ready[t->nready++] = k;
+#else
+			struct epoll_event ev[TIMERFD_MAX];
+
+			n = epoll_wait(t->epfd, ev, t->count, -1);
+			if (n < 0)
+				return -1;
+			/* handle them in the order reported */
+			while (n--)
+				t->ready[t->nready++] = ev[n].data.u32;
+#endif
+		}
+		k = t->ready[--t->nready];
+		if (read(t->fd[k], &t->expired, sizeof(t->expired)) ==
+		    sizeof(t->expired))
+			return k;
+		if (errno != EAGAIN)
+			return -1;
+	}
+}
+
+static void deadline_sift_down(struct deadline **heap, int count, int i)
+{
+	struct deadline *dl = heap[i];
+	int child;
+
+	while ((child = 2 * i + 1) < count) {
+		if (child + 1 < count && heap[child + 1]->next < heap[child]->next)
+			child++;
+		if (dl->next <= heap[child]->next)
+			break;
+		heap[i] = heap[child];
+		i = child;
+	}
+	heap[i] = dl;
+}
+
+/* Set up the deadlines of a thread to expire one period after start */
+static void deadline_start(struct deadline *dl, struct deadline **heap,
+			   int count, int64_t start)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		dl[i].next = start + dl[i].period;
+		heap[i] = &dl[i];
+	}
+	for (i = count / 2 - 1; i >= 0; i--)
+		deadline_sift_down(heap, count, i);
+}
+
+/*
+ * Account the latency of the earliest deadline and move it to its next
+ * period, skipping the periods that have passed already. O(log count).
+ */
+static void deadline_done(struct deadline **heap, int count, int64_t now,
+			  long diff)
+{
+	struct deadline *dl = heap[0];
+
+	if (!dl->cycles || diff < dl->min)
+		dl->min = diff;
+	if (!dl->cycles || diff > dl->max)
+		dl->max = diff;
+	dl->sum += diff;
+	dl->cycles++;
+
+	dl->next += dl->period;
+	if (now > dl->next)
+		dl->next += (now - dl->next + dl->period - 1) / dl->period *
+			dl->period;
+	deadline_sift_down(heap, count, 0);
+}
+
+/*
+ * Execution time of the --work of one cycle and its response time,
+ * from the wakeup deadline to the end of the work, both in ns.
+ */
+static void work_account(struct thread_stat *stat, int64_t exec, int64_t resp,
+			 int64_t deadline)
+{
+	if (resp > deadline)
+		stat->misses++;
+	if (!use_nsecs) {
+		exec /= 1000;
+		resp /= 1000;
+	}
+	if (exec < stat->exec_min)
+		stat->exec_min = exec;
+	if (exec > stat->exec_max)
+		stat->exec_max = exec;
+	stat->exec_sum += exec;
+	if (resp > stat->resp_max)
+		stat->resp_max = resp;
+	hist_record(&stat->exec_hist, exec);
+	hist_record(&stat->resp_hist, resp < 0 ? 0 : resp);
+}
+
+/*
+ * Hand a new max over to the spike thread, which attaches the counter
+ * deltas around it. A newer one replaces it until it is picked up, the
+ * sequence counter keeps the thread from pairing the cycle of one with
+ * the value of the other.
+ */
+static inline void spike_mark(struct thread_stat *stat, unsigned long cycle,
+			      long value, int breach)
+{
+	__atomic_store_n(&stat->spike_seq, stat->spike_seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	stat->spike_cycle = cycle;
+	stat->spike_value = value;
+	__atomic_store_n(&stat->spike_seq, stat->spike_seq + 1, __ATOMIC_RELEASE);
+	if (breach)
+		stat->spike_breach = 1;
+	__atomic_store_n(&stat->spike_pending, 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Periods that went by between the deadline of this wakeup and the
+ * wakeup itself, i.e. the ones skipped now. Counts the same way in
+ * all modes.
+ */
+static unsigned long missed_account(struct thread_stat *stat, int64_t late,
+				    int64_t period)
+{
+	unsigned long n;
+
+	if (late < period)
+		return 0;
+	n = late / period;
+	stat->missed += n;
+	stat->missed_cycles++;
+	stat->missed_hist[n < MISSED_BUCKETS ? n - 1 : MISSED_BUCKETS - 1]++;
+	return n;
+}
+
+/*
+ * Note this cycle in the flight recorder, plain stores only. The cpu
+ * of an unpinned thread comes from sched_getcpu(), a vDSO call on
+ * Linux that Cobalt would have to ask Linux for, so it is left unknown
+ * there. The context switch count is the one the drain thread sampled.
+ */
+static void flight_record(struct thread_stat *stat, int cpu, int64_t expected,
+			  int64_t wakeup, long diff, unsigned long overruns)
+{
+	struct flight *f = &stat->flight[stat->flight_head & (flight_size - 1)];
+
+#ifndef __COBALT__
+	if (cpu < 0)
+		cpu = sched_getcpu();
+#endif
+	f->expected = expected;
+	f->wakeup = wakeup;
+	f->diff = diff;
+	f->cpu = cpu;
+	f->overruns = overruns > UINT16_MAX ? UINT16_MAX : overruns;
+	f->ctxsw = __atomic_load_n(&stat->flight_ctxsw, __ATOMIC_RELAXED);
+	__atomic_store_n(&stat->flight_head, stat->flight_head + 1,
+			 __ATOMIC_RELEASE);
+}
+
+/*
+ * Print the recorder of a thread, oldest cycle first. The thread may
+ * still be running, so the ring is copied first and every row the
+ * thread could have rewritten meanwhile is dropped: all but the last
+ * flight_size - 1 cycles before the head seen after the copy.
+ */
+static void flight_dump(FILE *fp, int i)
+{
+	struct thread_stat *stat = statistics[i];
+	unsigned long head = __atomic_load_n(&stat->flight_head, __ATOMIC_ACQUIRE);
+	unsigned long k = head >= flight_size ? head - flight_size + 1 : 0;
+	unsigned long first = k, after;
+	struct flight *copy;
+	uint32_t ctxsw = 0;
+
+	copy = malloc(flight_size * sizeof(*copy));
+	if (!copy) {
+		fprintf(fp, "# Recorder thread %d: no memory for a copy\n", i);
+		return;
+	}
+	for (; k < head; k++)
+		copy[k & (flight_size - 1)] = stat->flight[k & (flight_size - 1)];
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	after = __atomic_load_n(&stat->flight_head, __ATOMIC_RELAXED);
+	if (after >= flight_size && first < after - flight_size + 1)
+		first = after - flight_size + 1;
+	if (first > head)
+		first = head;
+
+	fprintf(fp, "# Recorder thread %d: %lu of %lu cycles\n", i,
+		head - first, head);
+	if (head > first)
+		fprintf(fp, "# cycle expected wakeup diff cpu ctxsw overruns\n");
+	for (k = first; k < head; k++) {
+		struct flight *f = &copy[k & (flight_size - 1)];
+
+		fprintf(fp, "%lu %lld %lld %lld %d %u %u\n", k,
+			(long long)f->expected, (long long)f->wakeup,
+			(long long)f->diff,
+			f->cpu, ctxsw ? f->ctxsw - ctxsw : 0, f->overruns);
+		ctxsw = f->ctxsw;
+	}
+	free(copy);
+}
+
+/* Add the counts of one cycle to the latency bucket of diff */
+static void perf_account(struct thread_stat *stat, long diff,
+			 const uint64_t *delta)
+{
+	struct histogram *h = &stat->perf_hist;
+	uint64_t *sum;
+	unsigned int b;
+	int i;
+
+	if (diff < 0)
+		diff = 0;
+	b = hist_record(h, diff) ? h->nbuckets : hist_index(h, diff);
+	sum = &stat->perf_sum[b * PERF_EVENTS];
+	for (i = 0; i < PERF_EVENTS; i++)
+		sum[i] += delta[i];
+}
+
+/*
+ * Run by the last thread at the start barrier: one epoch for all of
+ * them, with --secaligned on a second boundary far enough ahead that no
+ * first deadline is in the past.
+ */
+static void start_release(void *arg)
+{
+	struct thread_param *par = arg;
+	struct timespec now;
+
+	clock_gettime(par->clock, &now);
+	if (secaligned) {
+		if (now.tv_nsec > 900000000)
+			now.tv_sec += 2;
+		else
+			now.tv_sec++;
+		now.tv_nsec = 0;
+	}
+	start_epoch = ts_to_ns(&now);
+}
+
+void *timerthread(void *param)
+{
+	struct thread_param *par = param;
+	struct sched_param schedp;
+	struct sigevent sigev;
+	sigset_t sigset;
+	timer_t timer;
+	struct timespec next, interval;
+	int64_t now_ns, next_ns, interval_ns, stop_ns = 0;
+	struct tsc_clock tsc = tsc_calib;
+	int64_t tsc_sync_ns;
+	struct timerfd_set tfd;
+	int tfd_cur = 0;
+	struct work work;
+	struct perf_set perf;
+	uint64_t perf_delta[PERF_EVENTS];
+	int64_t work_end = 0, work_limit;
+	struct rawmark rawmark;
+	int rawmark_fd = -1;
+	unsigned long overruns;
+	struct itimerval itimer;
+	struct itimerspec tspec;
+	struct thread_stat *stat = par->stats;
+	int stopped = 0;
+	cpu_set_t mask;
+	pthread_t thread;
+
+	/* if we're running in numa mode, set our memory node */
+	if (par->node != -1)
+		rt_numa_set_numa_run_on_node(par->node, par->cpu);
+
+	if (par->cpu != -1) {
+		CPU_ZERO(&mask);
+		CPU_SET(par->cpu, &mask);
+		thread = pthread_self();
+		if(pthread_setaffinity_np(thread, sizeof(mask), &mask) == -1)
+			warn("Could not set CPU affinity to CPU #%d\n", par->cpu);
+	}
+
+	interval_ns = (int64_t)par->interval * 1000;
+	ns_to_ts(interval_ns, &interval);
+
+	stat->tid = gettid();
+	if (stat->shm)
+		stat->shm->tid = stat->tid;
+
+	/* SIGUSR1 is for the main thread, see sighand() */
+	sigemptyset(&sigset);
+	sigaddset(&sigset, SIGUSR1);
+	sigprocmask(SIG_BLOCK, &sigset, NULL);
+
+	sigemptyset(&sigset);
+	sigaddset(&sigset, par->signal);
+	sigprocmask(SIG_BLOCK, &sigset, NULL);
+
+	if (par->mode == MODE_CYCLIC) {
+#ifndef USE_MUSL
+		sigev.sigev_notify = SIGEV_THREAD_ID | SIGEV_SIGNAL;
+		sigev.sigev_signo = par->signal;
+		sigev.sigev_notify_thread_id = stat->tid;
+#endif
+		timer_create(par->clock, &sigev, &timer);
+		tspec.it_interval = interval;
+	}
+
+	/* set up the work here, its memory should be local to our cpu */
+	memset(&work, 0, sizeof(work));
+	if (work_spec.kind &&
+	    work_init(&work, &work_spec, par->tnum, work_cold))
+		fatal("timerthread%d: failed to set up the work: %s\n",
+		      par->tnum, strerror(errno));
+	/* cold caches have to be ready by the next wakeup */
+	if (work_cold && work.evict_ns >= interval_ns)
+		fatal("timerthread%d: --work-cold takes %lld us per cycle, "
+		      "more than the interval of %lld us\n", par->tnum,
+		      (long long)work.evict_ns / 1000,
+		      (long long)interval_ns / 1000);
+	work_limit = work_deadline ? (int64_t)work_deadline * 1000 : interval_ns;
+
+	/* the counters follow this thread */
+	if (use_perf) {
+		int i;
+
+		if (perf_open(&perf))
+			fatal("timerthread%d: no hardware counters: %s\n",
+			      par->tnum, strerror(errno));
+		for (i = 0; i < PERF_EVENTS; i++)
+			if (perf.ctr[i].fd >= 0)
+				stat->perf_events |= 1 << i;
+		stat->perf_kernel = perf.kernel;
+	}
+
+	/* each thread writes its markers through its own descriptor */
+	if (tracemark_raw) {
+		rawmark_fd = open(tracemark_raw_path, O_WRONLY);
+		if (rawmark_fd < 0)
+			fatal("timerthread%d: unable to open %s: %s\n",
+			      par->tnum, tracemark_raw_path, strerror(errno));
+		rawmark.id = TRACEMARK_RAW_ID + par->tnum;
+	}
+
+	memset(&schedp, 0, sizeof(schedp));
+	if (par->policy == SCHED_DEADLINE) {
+		struct sched_attr attr = {
+			.size = sizeof(attr),
+			.sched_policy = SCHED_DEADLINE,
+			.sched_runtime = par->dl_runtime,
+			.sched_deadline = par->dl_deadline,
+			.sched_period = par->dl_period,
+		};
+
+		/* EPERM if pinned to less than the root domain, EBUSY if over the bandwidth */
+		if (sched_setattr(0, &attr, 0))
+			fatal("timerthread%d: failed to set SCHED_DEADLINE "
+			      "%llu/%llu/%llu ns: %s\n", par->tnum,
+			      (unsigned long long)par->dl_runtime,
+			      (unsigned long long)par->dl_deadline,
+			      (unsigned long long)par->dl_period, strerror(errno));
+	} else {
+		schedp.sched_priority = par->prio;
+		if (pthread_setschedparam(pthread_self(), par->policy, &schedp))
+			fatal("timerthread%d: failed to set priority to %d\n", par->cpu, par->prio);
+	}
+
+	/* anchor our copy of the cycle counter on our own CPU */
+	if (use_tsc)
+		tsc_resync(&tsc);
+
+	/* Get current time */
+	if (aligned || secaligned) {
+		barrier_wait(&start_barr, start_release, par);
+		thread_clock(par->clock, &tsc, &stat->start_ns);
+		now_ns = start_epoch;
+		if (aligned)
+			now_ns += (int64_t)offset * par->tnum;
+		else
+			now_ns += offset;
+	} else
+		thread_clock(par->clock, &tsc, &now_ns);
+
+	next_ns = now_ns + interval_ns;
+	tsc_sync_ns = next_ns + TSC_RESYNC;
+
+	if (nr_windows)
+		window_start(stat, now_ns);
+
+	if (duration)
+		stop_ns = now_ns + (int64_t)duration * NSEC_PER_SEC;
+
+	if (par->mode == MODE_CYCLIC) {
+		if (par->timermode == TIMER_ABSTIME)
+			ns_to_ts(next_ns, &tspec.it_value);
+		else {
+			tspec.it_value = interval;
+		}
+		timer_settime(timer, par->timermode, &tspec, NULL);
+	}
+
+	if (par->mode == MODE_SYS_ITIMER) {
+		itimer.it_interval.tv_sec = interval.tv_sec;
+		itimer.it_interval.tv_usec = interval.tv_nsec / 1000;
+		itimer.it_value = itimer.it_interval;
+		setitimer (ITIMER_REAL, &itimer, NULL);
+	}
+
+	if (par->mode == MODE_DEADLINES)
+		deadline_start(stat->deadlines, stat->dlheap, par->deadlines,
+			       now_ns);
+
+	if (par->mode == MODE_TIMERFD &&
+	    timerfd_start(&tfd, par->clock, par->timers, next_ns, interval_ns)) {
+		warn("timerfd setup failed: %s\n", strerror(errno));
+		goto out;
+	}
+
+	stat->threadstarted++;
+
+	while (!shutdown) {
+
+		int64_t diff;
+		unsigned long cycle;
+		int sigs, ret, newmax;
 
 		/* Wait for next period */
 		switch (par->mode) {
@@ -873,13 +1978,14 @@ void *timerthread(void *param)
 
 		case MODE_CLOCK_NANOSLEEP:
 			if (par->timermode == TIMER_ABSTIME) {
+				ns_to_ts(next_ns, &next);
 				if ((ret = clock_nanosleep(par->clock, TIMER_ABSTIME, &next, NULL))) {
 					if (ret != EINTR)
 						warn("clock_nanosleep failed. errno: %d\n", errno);
 					goto out;
 				}
 			} else {
-				if ((ret = clock_gettime(par->clock, &now))) {
+				if ((ret = thread_clock(par->clock, &tsc, &now_ns))) {
 					if (ret != EINTR)
 						warn("clock_gettime() failed: %s", strerror(errno));
 					goto out;
@@ -889,14 +1995,35 @@ void *timerthread(void *param)
 						warn("clock_nanosleep() failed. errno: %d\n", errno);
 					goto out;
 				}
-				next.tv_sec = now.tv_sec + interval.tv_sec;
-				next.tv_nsec = now.tv_nsec + interval.tv_nsec;
-				tsnorm(&next);
+				next_ns = now_ns + interval_ns;
+			}
+			break;
+
+		case MODE_TIMERFD:
+			tfd_cur = timerfd_next(&tfd);
+			if (tfd_cur < 0) {
+				if (errno != EINTR)
+					warn("timerfd wait failed. errno: %d\n", errno);
+				goto out;
+			}
+			next_ns = tfd.next[tfd_cur];
+			break;
+
+		case MODE_DEADLINES:
+			/* deadlines which are due already are served right away */
+			next_ns = stat->dlheap[0]->next;
+			if (next_ns > now_ns) {
+				ns_to_ts(next_ns, &next);
+				if ((ret = clock_nanosleep(par->clock, TIMER_ABSTIME, &next, NULL))) {
+					if (ret != EINTR)
+						warn("clock_nanosleep failed. errno: %d\n", errno);
+					goto out;
+				}
 			}
 			break;
 
 		case MODE_SYS_NANOSLEEP:
-			if ((ret = clock_gettime(par->clock, &now))) {
+			if ((ret = thread_clock(par->clock, &tsc, &now_ns))) {
 				if (ret != EINTR)
 					warn("clock_gettime() failed: errno %d\n", errno);
 				goto out;
@@ -906,79 +2033,159 @@ void *timerthread(void *param)
 					warn("nanosleep failed. errno: %d\n", errno);
 				goto out;
 			}
-			next.tv_sec = now.tv_sec + interval.tv_sec;
-			next.tv_nsec = now.tv_nsec + interval.tv_nsec;
-			tsnorm(&next);
+			next_ns = now_ns + interval_ns;
 			break;
 		}
 
-		if ((ret = clock_gettime(par->clock, &now))) {
+		if ((ret = thread_clock(par->clock, &tsc, &now_ns))) {
 			if (ret != EINTR)
 				warn("clock_getttime() failed. errno: %d\n", errno);
 			goto out;
 		}
 
-		if (use_nsecs)
-			diff = calcdiff_ns(now, next);
-		else
-			diff = calcdiff(now, next);
+		if (use_perf)
+			perf_read(&perf, perf_delta);
+
+		/* the work starts right away, the accounting waits for it */
+		if (work_spec.kind) {
+			work_run(&work);
+			thread_clock(par->clock, &tsc, &work_end);
+		}
+
+		/* one stretch of the next node's working set */
+		if (numamat_lines) {
+			int mnode = numamat_walk[stat->cycles % numamat_walk_nodes];
+			int cpu = par->cpu >= 0 ? par->cpu : sched_getcpu();
+			int cnode = cpu >= 0 && cpu < CPU_SETSIZE ?
+				numamat_cpu_node[cpu] : 0;
+			int64_t touch_start, touch_end;
+
+			thread_clock(par->clock, &tsc, &touch_start);
+			stat->numa_pos[mnode] = numamat_touch(stat->numa_pos[mnode],
+							      numamat_lines);
+			thread_clock(par->clock, &tsc, &touch_end);
+			numamat_account(&stat->numa_cells[cnode * numamat_nodes + mnode],
+					touch_end - touch_start, touch_end - next_ns);
+		}
+
+		diff = now_ns - next_ns;
+		if (!use_nsecs)
+			diff /= 1000;
+		cycle = stat->cycles;
+
+		stat_write_begin(stat);
 		if (diff < stat->min)
 			stat->min = diff;
-		if (diff > stat->max) {
+		newmax = diff > stat->max;
+		if (newmax)
 			stat->max = diff;
-			if (refresh_on_max)
-				pthread_cond_signal(&refresh_on_max_cond);
-		}
 		stat->avg += (double) diff;
+		stat->act = diff;
+		stat->cycles = cycle + 1;
+		if (quantiles)
+			stat_quantiles(stat, diff);
 
-		if (duration && (calcdiff(now, stop) >= 0))
-			shutdown++;
+		/* Update the histogram */
+		if (histogram && hist_record(&stat->hist, diff) &&
+		    stat->num_outliers < hist_outliers)
+			stat->outliers[stat->num_outliers++] = cycle;
+
+		if (stat->shm)
+			telemetry_publish(stat);
+		stat_write_end(stat);
 
+		/* freeze the trace before any of the optional bookkeeping */
 		if (!stopped && tracelimit && (diff > tracelimit)) {
 			stopped++;
-			tracemark("hit latency threshold (%llu > %d)",
-				  (unsigned long long) diff, tracelimit);
-			tracing(0);
+#ifdef __COBALT__
+			xntrace_user_freeze(diff, 0);
+#endif
+			tracestop(diff);
 			shutdown++;
+			if (spike_period)
+				spike_mark(stat, cycle, diff, 1);
 			pthread_mutex_lock(&break_thread_id_lock);
 			if (break_thread_id == 0)
 				break_thread_id = stat->tid;
 			break_thread_value = diff;
 			pthread_mutex_unlock(&break_thread_id_lock);
 		}
-		stat->act = diff;
 
-		if (par->bufmsk)
-			stat->values[stat->cycles & par->bufmsk] = diff;
+		if (newmax && refresh_on_max &&
+		    !__atomic_exchange_n(&refresh_pending, 1, __ATOMIC_ACQ_REL))
+			sem_post(&refresh_sem);
 
-		/* Update the histogram */
-		if (histogram) {
-			if (diff >= histogram) {
-				stat->hist_overflow++;
-				if (stat->num_outliers < histogram)
-					stat->outliers[stat->num_outliers++] = stat->cycles;
-			}
-			else
-				stat->hist_array[diff]++;
-		}
+		if (newmax && spike_period)
+			spike_mark(stat, cycle, diff, 0);
+
+		if (work_spec.kind)
+			work_account(stat, work_end - now_ns, work_end - next_ns,
+				     work_limit);
+
+		if (use_perf)
+			perf_account(stat, diff, perf_delta);
 
-		stat->cycles++;
+		overruns = missed_account(stat, now_ns - next_ns,
+					  par->mode == MODE_DEADLINES ?
+					  stat->dlheap[0]->period : interval_ns);
 
-		next.tv_sec += interval.tv_sec;
-		next.tv_nsec += interval.tv_nsec;
-		if (par->mode == MODE_CYCLIC) {
-			int overrun_count = timer_getoverrun(timer);
-			next.tv_sec += overrun_count * interval.tv_sec;
-			next.tv_nsec += overrun_count * interval.tv_nsec;
+		if (flight_size)
+			flight_record(stat, par->cpu, next_ns, now_ns, diff,
+				      overruns);
+
+		if (nr_windows)
+			window_record(stat, now_ns, diff);
+
+		if (rawmark_fd >= 0) {
+			rawmark.cpu = sched_getcpu();
+			rawmark.cycle = cycle;
+			rawmark.latency = now_ns - next_ns;
+			write_check(rawmark_fd, &rawmark, sizeof(rawmark));
 		}
-		tsnorm(&next);
 
-		while (tsgreater(&now, &next)) {
-			next.tv_sec += interval.tv_sec;
-			next.tv_nsec += interval.tv_nsec;
-			tsnorm(&next);
+		if (duration && now_ns >= stop_ns)
+			shutdown++;
+
+		if (par->bufmsk)
+			ring_push(&stat->ring, par->bufmsk, cycle, diff);
+
+		if (par->mode == MODE_TIMERFD) {
+			/* the expiration count includes the overruns */
+			tfd.next[tfd_cur] += tfd.expired * interval_ns;
+			next_ns = tfd.next[tfd_cur];
+		} else if (par->mode == MODE_DEADLINES) {
+			deadline_done(stat->dlheap, par->deadlines, now_ns, diff);
+			next_ns = stat->dlheap[0]->next;
+		} else
+			next_ns += interval_ns;
+		if (par->mode == MODE_CYCLIC)
+			next_ns += timer_getoverrun(timer) * interval_ns;
+
+		/* skip the periods we overran in one step */
+		if (now_ns > next_ns)
+			next_ns += (now_ns - next_ns + interval_ns - 1) /
+				interval_ns * interval_ns;
+
+		/*
+		 * Re-anchor the cycle counter against the clock after the
+		 * sample is accounted, the offset found tells how far the
+		 * two timestamp sources went apart.
+		 */
+		if (use_tsc && now_ns >= tsc_sync_ns) {
+			int64_t offset = tsc_resync(&tsc);
+
+			if (offset < 0)
+				offset = -offset;
+			if (offset > stat->tsc_offset_max)
+				stat->tsc_offset_max = offset;
+			stat->tsc_offset_sum += offset;
+			stat->tsc_syncs++;
+			tsc_sync_ns = now_ns + TSC_RESYNC;
 		}
 
+		if (work_cold)
+			work_evict(&work);
+
 		if (par->max_cycles && par->max_cycles == stat->cycles)
 			break;
 	}
@@ -987,6 +2194,15 @@ out:
 	if (par->mode == MODE_CYCLIC)
 		timer_delete(timer);
 
+	if (par->mode == MODE_TIMERFD)
+		timerfd_stop(&tfd);
+
+	work_exit(&work);
+	if (use_perf)
+		perf_close(&perf);
+	if (rawmark_fd >= 0)
+		close(rawmark_fd);
+
 	if (par->mode == MODE_SYS_ITIMER) {
 		itimer.it_value.tv_sec = 0;
 		itimer.it_value.tv_usec = 0;
@@ -1000,10 +2216,31 @@ out:
 	sched_setscheduler(0, SCHED_OTHER, &schedp);
 
 	stat->threadstarted = -1;
+	sem_post(&refresh_sem);
 
 	return NULL;
 }
 
+/*
+ * VERSION_STRING is a bare number from automake and a string literal
+ * from CMake, both builds report it without the quotes.
+ */
+static const char *version_string(void)
+{
+	static char version[32];
+	const char *v = STR(VERSION_STRING);
+	size_t len = strlen(v);
+
+	if (len >= 2 && v[0] == '"' && v[len - 1] == '"') {
+		v++;
+		len -= 2;
+	}
+	if (len >= sizeof(version))
+		len = sizeof(version) - 1;
+	memcpy(version, v, len);
+	version[len] = '\0';
+	return version;
+}
 
 /* Print usage information */
 static void display_help(int error)
@@ -1020,7 +2257,7 @@ static void display_help(int error)
 			strcpy(tracers, "none");
 	}
 
-	printf("cyclictest V %1.2f\n", VERSION_STRING);
+	printf("cyclictest V %s\n", version_string());
 	printf("Usage:\n"
 	       "cyclictest <options>\n\n"
 #if LIBNUMA_API_VERSION >= 2
@@ -1035,12 +2272,21 @@ static void display_help(int error)
 	       "                           with NUM pin all threads to the processor NUM\n"
 #endif
 	       "-A USEC  --aligned=USEC    align thread wakeups to a specific offset\n"
+	       "	 --audit[=strict]  check the measurement cpus for device interrupts,\n"
+	       "                           isolation, nohz_full, rcu_nocbs, workqueues and\n"
+	       "                           softirqs before the test; strict refuses to\n"
+	       "                           measure on cpus that are not isolated\n"
 	       "-b USEC  --breaktrace=USEC send break trace command when latency > USEC\n"
 	       "-B       --preemptirqs     both preempt and irqsoff tracing (used with -b)\n"
+	       "	 --binlog=<path>   write every sample to a binary log at path,\n"
+	       "                           see cyclictest-decode\n"
 	       "-c CLOCK --clock=CLOCK     select clock\n"
 	       "                           0 = CLOCK_MONOTONIC (default)\n"
 	       "                           1 = CLOCK_REALTIME\n"
 	       "-C       --context         context switch tracing (used with -b)\n"
+	       "	 --deadlines=K     serve K periodic deadlines per thread from a min-heap,\n"
+	       "                           with intervals INTV, INTV+DIST, INTV+2*DIST, ...\n"
+	       "                           and print the latency of each one at the end\n"
 	       "-d DIST  --distance=DIST   distance of thread intervals in us default=500\n"
 	       "-D       --duration=t      specify a length for the test run\n"
 	       "                           default is in seconds, but 'm', 'h', or 'd' maybe added\n"
@@ -1048,55 +2294,118 @@ static void display_help(int error)
 	       "	 --latency=PM_QOS  write PM_QOS to /dev/cpu_dma_latency\n"
 	       "-E       --event           event tracing (used with -b)\n"
 	       "-f       --ftrace          function trace (when -b is active)\n"
-	       "-F       --fifo=<path>     create a named pipe at path and write stats to it\n"
+	       "-F       --fifo=<path>     serve stats on a unix domain socket at path, each\n"
+	       "                           client gets them on connect and on every request;\n"
+	       "                           this is no longer a named pipe, read it with e.g.\n"
+	       "                           socat - UNIX-CONNECT:<path>\n"
 	       "-h       --histogram=US    dump a latency histogram to stdout after the run\n"
 	       "                           (with same priority about many threads)\n"
 	       "                           US is the max time to be be tracked in microseconds\n"
 	       "-H       --histofall=US    same as -h except with an additional summary column\n"
+	       "	 --histdigits=NUM  significant digits of the histogram buckets, 1-5\n"
+	       "                           default=3, values < 2048 are counted exactly\n"
 	       "-i INTV  --interval=INTV   base interval of thread in us default=1000\n"
+	       "	 --json=<path>     write the parameters and results of the run to\n"
+	       "                           path as one JSON document\n"
 	       "-I       --irqsoff         Irqsoff tracing (used with -b)\n"
 	       "-l LOOPS --loops=LOOPS     number of loops: default=0(endless)\n"
+	       "	 --load=KIND[:N[:DUTY]] run N workers (default 1) of load KIND next to\n"
+	       "                           the test, busy DUTY percent (default 100) of each\n"
+	       "                           10ms; KIND is membw, cache, syscall, fork or net;\n"
+	       "                           may be given more than once\n"
+	       "	 --load-affinity=CPUSET pin the load workers to CPUSET, round robin\n"
 	       "	 --laptop	   Save battery when running cyclictest\n"
 	       "			   This will give you poorer realtime results\n"
 	       "			   but will not drain your battery so quickly\n"
 	       "-m       --mlockall        lock current and future memory allocations\n"
 	       "-M       --refresh_on_max  delay updating the screen until a new max latency is hit\n"
+	       "	 --refresh=MS      update the screen every MS milliseconds, default=10\n"
 	       "-n       --nanosleep       use clock_nanosleep\n"
 	       "	 --notrace	   suppress tracing\n"
 	       "-N       --nsecs           print results in ns instead of us (default us)\n"
 	       "-o RED   --oscope=RED      oscilloscope mode, reduce verbose output by RED\n"
 	       "-O TOPT  --traceopt=TOPT   trace option\n"
 	       "-p PRIO  --prio=PRIO       priority of highest prio thread\n"
+	       "	 --perf            count cycles, instructions, cache, dTLB and branch\n"
+	       "                           misses of each thread with perf_event_open(), read\n"
+	       "                           with rdpmc after every wakeup, and report them per\n"
+	       "                           latency bucket\n"
 	       "-P       --preemptoff      Preempt off tracing (used with -b)\n"
 	       "-q       --quiet           print only a summary on exit\n"
+	       "	 --quantiles       add standard deviation, max of the display window\n"
+	       "                           and P99/P99.9/P99.99 estimates to the status\n"
+	       "                           lines, constant cost per sample, no -h needed\n"
 	       "	 --priospread       spread priority levels starting at specified value\n"
+	       "	 --recorder[=N]    keep the last N cycles of each thread (default\n"
+	       "                           4096): expected and wakeup time, latency, cpu,\n"
+	       "                           context switches and missed periods; printed to\n"
+	       "                           stderr on SIGUSR1 and after a -b breach; the\n"
+	       "                           context switches are sampled every ms\n"
 	       "-r       --relative        use relative timer instead of absolute\n"
 	       "-R       --resolution      check clock resolution, calling clock_gettime() many\n"
 	       "                           times.  list of clock_gettime() values will be\n"
 	       "                           reported with -X\n"
 	       "         --secaligned [USEC] align thread wakeups to the next full second,\n"
 	       "                           and apply the optional offset\n"
+	       "	 --shm=NAME        publish the live statistics and histogram in the\n"
+	       "                           POSIX shared memory object NAME, see telemetry.h\n"
 	       "-s       --system          use sys_nanosleep and sys_setitimer\n"
 	       "-S       --smp             Standard SMP testing: options -a -t -n and\n"
 	       "                           same priority of all threads\n"
+	       "	 --spikes[=MS]     snapshot /proc/interrupts, /proc/softirqs and the\n"
+	       "                           thread context switches every MS ms (default\n"
+	       "                           100) and report what fired around each new max\n"
+	       "                           on the thread's cpu (all cpus if not pinned)\n"
 	       "-t       --threads         one thread per available processor\n"
 	       "-t [NUM] --threads=NUM     number of threads:\n"
 	       "                           without NUM, threads = max_cpus\n"
 	       "                           without -t default = 1\n"
+	       "         --timerfd [N]     wait for N timerfds per thread (default 1) with\n"
+	       "                           epoll_wait(), select() on Cobalt; the timers are\n"
+	       "                           spread over the interval and served in turn\n"
 	       "-T TRACE --tracer=TRACER   set tracing function\n"
 	       "    configured tracers: %s\n"
+	       "	 --tracemark-raw   write a binary record of every cycle (thread,\n"
+	       "                           cpu, cycle, latency in ns) to trace_marker_raw\n"
+	       "	 --tsc             take the wakeup timestamps from the CPU cycle counter\n"
+	       "                           (x86_64 rdtscp, arm64 cntvct), calibrated against\n"
+	       "                           the selected clock and resynced every second\n"
 	       "-u       --unbuffered      force unbuffered output for live processing\n"
 #ifdef NUMA
 	       "-U       --numa            Standard NUMA testing (similar to SMP option)\n"
 	       "                           thread data structures allocated from local node\n"
 #endif
+	       "	 --numa-matrix[=LINES[:MB]] place an MB working set (default 64) on every\n"
+	       "                           memory node, follow LINES cache lines (default\n"
+	       "                           256) of one node after each wakeup, going round\n"
+	       "                           the nodes, and report the time per cpu node and\n"
+	       "                           memory node; run threads on each node to fill\n"
+	       "                           the matrix\n"
 	       "-v       --verbose         output values on stdout for statistics\n"
 	       "                           format: n:c:v n=tasknum c=count v=value in us\n"
 	       "-w       --wakeup          task wakeup tracing (used with -b)\n"
+	       "	 --windows=S[,S..] keep min/avg/max/p99 of every window of S seconds,\n"
+	       "                           up to 3 window lengths, e.g. --windows=1,10,60\n"
+	       "	 --window-log=<path> write the window time series to path at the end\n"
+	       "                           of the run, as JSON lines\n"
+	       "	 --window-csv      write the window time series as CSV instead\n"
+	       "	 --work=WORK       run WORK after each wakeup and report its execution\n"
+	       "                           and response time, WORK is matvec[:N] (N x N\n"
+	       "                           doubles, default 64), memcpy[:KB] (default 64)\n"
+	       "                           or LIB.so[:ARG] exporting cyclictest_work()\n"
+	       "	 --work-cold       flush the work out of the caches between two cycles,\n"
+	       "                           refused if that takes longer than the interval\n"
+	       "	 --work-deadline=US response time counted as a miss, default=interval\n"
 	       "-W       --wakeuprt        rt task wakeup tracing (used with -b)\n"
 	       "	 --dbg_cyclictest  print info useful for debugging cyclictest\n"
-	       "	 --policy=POLI     policy of realtime thread, POLI may be fifo(default) or rr\n"
-	       "                           format: --policy=fifo(default) or --policy=rr\n",
+	       "	 --policy=POLI     policy of realtime thread, POLI may be fifo(default), rr\n"
+	       "                           or deadline\n"
+	       "                           format: --policy=fifo(default) or --policy=rr\n"
+	       "	 --dl-runtime=US   SCHED_DEADLINE runtime, default=10%% of the deadline\n"
+	       "	 --dl-deadline=US  SCHED_DEADLINE relative deadline, default=period\n"
+	       "	 --dl-period=US    SCHED_DEADLINE period, default=thread interval;\n"
+	       "                           deadline threads can not be pinned with -a, -S\n"
+	       "                           or --numa\n",
 	       tracers
 		);
 	if (error)
@@ -1112,6 +2421,11 @@ void application_usage(void)
 static int use_nanosleep;
 static int timermode = TIMER_ABSTIME;
 static int use_system;
+static int timerfd_count;
+static int deadline_count;
+static int dl_runtime;
+static int dl_deadline;
+static int dl_period;
 static int priority;
 static int policy = SCHED_OTHER;	/* default policy if not specified */
 static int num_threads = 1;
@@ -1121,6 +2435,11 @@ static int quiet;
 static int interval = DEFAULT_INTERVAL;
 static int distance = -1;
 static struct bitmask *affinity_mask = NULL;
+static struct bitmask *load_mask = NULL;
+static struct load_worker *load_workers;
+static int nr_load;
+static int audit_mode;		/* 1 warns, 2 refuses to measure */
+static struct audit audit;
 static int smp = 0;
 
 enum {
@@ -1140,16 +2459,16 @@ static unsigned int is_cpumask_zero(const struct bitmask *mask)
 	return (rt_numa_bitmask_count(mask) == 0);
 }
 
-static int cpu_for_thread(int thread_num, int max_cpus)
+static int cpu_for_thread(int thread_num, int max_cpus, struct bitmask *mask)
 {
 	unsigned int m, cpu, i, num_cpus;
-	num_cpus = rt_numa_bitmask_count(affinity_mask);
+	num_cpus = rt_numa_bitmask_count(mask);
 
 	m = thread_num % num_cpus;
 
 	/* there are num_cpus bits set, we want position of m'th one */
 	for (i = 0, cpu = 0; i < max_cpus; i++) {
-		if (rt_numa_bitmask_isbitset(affinity_mask, i)) {
+		if (rt_numa_bitmask_isbitset(mask, i)) {
 			if (cpu == m)
 				return i;
 			cpu++;
@@ -1160,22 +2479,25 @@ static int cpu_for_thread(int thread_num, int max_cpus)
 }
 
 
-static void parse_cpumask(const char *option, const int max_cpus)
+static struct bitmask *parse_cpumask(const char *option, const int max_cpus)
 {
-	affinity_mask = rt_numa_parse_cpustring(option, max_cpus);
-	if (affinity_mask) {
-		if (is_cpumask_zero(affinity_mask)) {
-			rt_bitmask_free(affinity_mask);
-			affinity_mask = NULL;
+	struct bitmask *mask;
+
+	mask = rt_numa_parse_cpustring(option, max_cpus);
+	if (mask) {
+		if (is_cpumask_zero(mask)) {
+			rt_bitmask_free(mask);
+			mask = NULL;
 		}
 	}
-	if (!affinity_mask)
+	if (!mask)
 		display_help(1);
 
 	if (verbose) {
 		printf("%s: Using %u cpus.\n", __func__,
-			rt_numa_bitmask_count(affinity_mask));
+			rt_numa_bitmask_count(mask));
 	}
+	return mask;
 }
 
 
@@ -1191,6 +2513,8 @@ static void handlepolicy(char *polname)
 		policy = SCHED_FIFO;
 	else if (strncasecmp(polname, "rr", 2) == 0)
 		policy = SCHED_RR;
+	else if (strncasecmp(polname, "deadline", 8) == 0)
+		policy = SCHED_DEADLINE;
 	else	/* default policy if we don't recognize the request */
 		policy = SCHED_OTHER;
 }
@@ -1215,6 +2539,9 @@ static char *policyname(int policy)
 	case SCHED_IDLE:
 		policystr = "idle";
 		break;
+	case SCHED_DEADLINE:
+		policystr = "deadline";
+		break;
 	}
 	return policystr;
 }
@@ -1229,9 +2556,150 @@ enum option_values {
 	OPT_QUIET, OPT_PRIOSPREAD, OPT_RELATIVE, OPT_RESOLUTION, OPT_SYSTEM,
 	OPT_SMP, OPT_THREADS, OPT_TRACER, OPT_UNBUFFERED, OPT_NUMA, OPT_VERBOSE,
 	OPT_WAKEUP, OPT_WAKEUPRT, OPT_DBGCYCLIC, OPT_POLICY, OPT_HELP, OPT_NUMOPTS,
-	OPT_ALIGNED, OPT_LAPTOP, OPT_SECALIGNED,
+	OPT_ALIGNED, OPT_LAPTOP, OPT_SECALIGNED, OPT_BINLOG,
+	OPT_HISTDIGITS, OPT_QUANTILES, OPT_WINDOWS, OPT_WINDOWLOG,
+	OPT_WINDOWCSV, OPT_JSON, OPT_REFRESHRATE, OPT_SHM, OPT_TSC,
+	OPT_TIMERFD, OPT_DEADLINES, OPT_LOAD, OPT_LOADAFFINITY, OPT_WORK,
+	OPT_WORKCOLD, OPT_WORKDEADLINE,
+	/* keep clear of the short option characters from here on */
+	OPT_DLRUNTIME = 256, OPT_DLDEADLINE, OPT_DLPERIOD, OPT_AUDIT,
+	OPT_SPIKES, OPT_PERF, OPT_TRACEMARKRAW, OPT_RECORDER, OPT_NUMAMATRIX,
 };
 
+/* Parse the comma separated window lengths of --windows */
+static int parse_windows(char *arg)
+{
+	char *end;
+
+	nr_windows = 0;
+	while (*arg) {
+		if (nr_windows == WINDOW_LEVELS)
+			return -1;
+		window_secs[nr_windows] = strtol(arg, &end, 10);
+		if (end == arg || window_secs[nr_windows] <= 0)
+			return -1;
+		nr_windows++;
+		if (*end == ',')
+			end++;
+		else if (*end)
+			return -1;
+		arg = end;
+	}
+	return nr_windows ? 0 : -1;
+}
+
+/* Add the workers of one --load=KIND[:N[:DUTY]] */
+static int parse_load(char *arg)
+{
+	char *kind = strtok(arg, ":");
+	char *num = strtok(NULL, ":");
+	char *duty = strtok(NULL, ":");
+	int k, n = num ? atoi(num) : 1;
+	int d = duty ? atoi(duty) : 100;
+	struct load_worker *w;
+
+	k = kind ? load_kind(kind) : -1;
+	if (k < 0 || n < 1 || d < 1 || d > 100 || strtok(NULL, ":"))
+		return -1;
+	w = realloc(load_workers, (nr_load + n) * sizeof(*w));
+	if (!w)
+		return -1;
+	load_workers = w;
+	while (n--)
+		load_init(&load_workers[nr_load++], k, -1, d);
+	return 0;
+}
+
+/* The cpus the measurement threads are going to run on */
+static void audit_cpus(cpu_set_t *set, int max_cpus)
+{
+	int i;
+
+	CPU_ZERO(set);
+	switch (setaffinity) {
+	case AFFINITY_UNSPECIFIED:
+		/* not pinned, anywhere we may run */
+		sched_getaffinity(0, sizeof(*set), set);
+		break;
+	case AFFINITY_SPECIFIED:
+		for (i = 0; i < num_threads; i++)
+			CPU_SET(cpu_for_thread(i, max_cpus, affinity_mask), set);
+		break;
+	case AFFINITY_USEALL:
+		for (i = 0; i < num_threads; i++)
+			CPU_SET(i % max_cpus, set);
+		break;
+	}
+}
+
+/* One line of findings of cpu c */
+static void audit_format(char *buf, size_t len, const struct cpu_audit *c)
+{
+	size_t n;
+	int k, more = 0;
+
+	n = snprintf(buf, len, "cpu %d:", c->cpu);
+	for (k = 0; k < AUDIT_FLAGS && n < len; k++) {
+		if (!(c->flags & (1 << k)) || k == AUDIT_IRQ)
+			continue;
+		n += snprintf(buf + n, len - n, "%s %s", more++ ? "," : "",
+			      audit_flag_names[k]);
+	}
+	if (c->nr_irqs && n < len) {
+		n += snprintf(buf + n, len - n, "%s %d %s (", more++ ? "," : "",
+			      c->nr_irqs, audit_flag_names[AUDIT_IRQ]);
+		for (k = 0; k < c->nr_irqs && k < AUDIT_IRQS && n < len; k++)
+			n += snprintf(buf + n, len - n, "%s%d", k ? " " : "",
+				      c->irqs[k]);
+		if (n < len)
+			n += snprintf(buf + n, len - n, "%s)",
+				      c->nr_irqs > AUDIT_IRQS ? " ..." : "");
+	}
+	if (!more && n < len)
+		n += snprintf(buf + n, len - n, " quiet");
+	if (audit.nr_softirqs && n < len)
+		n += snprintf(buf + n, len - n, "; softirqs/s");
+	for (k = 0; k < audit.nr_softirqs && n < len; k++)
+		if (c->softirqs[k])
+			n += snprintf(buf + n, len - n, " %s:%llu",
+				      audit.softirq_names[k],
+				      (unsigned long long)c->softirqs[k] *
+				      1000 / audit.sample_ms);
+}
+
+/*
+ * Pre-flight check of the measurement cpus. Warns about everything
+ * that may disturb them, with --audit=strict interrupts, workqueues
+ * and missing isolation make us refuse to measure.
+ */
+static void audit_check(int max_cpus)
+{
+	char line[1024];
+	cpu_set_t set;
+	int i, severe = 0;
+
+	if (setaffinity == AFFINITY_UNSPECIFIED)
+		warn("audit: the measurement threads are not pinned (-a)\n");
+	audit_cpus(&set, max_cpus);
+	if (audit_run(&audit, &set, AUDIT_SAMPLE))
+		fatal("isolation audit failed: %s\n", strerror(errno));
+
+	for (i = 0; i < audit.nr_cpus; i++) {
+		struct cpu_audit *c = &audit.cpus[i];
+
+		if (c->flags & AUDIT_SEVERE)
+			severe++;
+		if (!c->flags)
+			continue;
+		audit_format(line, sizeof(line), c);
+		warn("audit: %s\n", line);
+	}
+	if (severe && audit_mode > 1)
+		fatal("%d of %d measurement cpus are not isolated, not measuring "
+		      "(--audit without =strict only warns)\n", severe,
+		      audit.nr_cpus);
+}
+
 /* Process commandline options */
 static void process_options (int argc, char *argv[], int max_cpus)
 {
@@ -1248,10 +2716,16 @@ static void process_options (int argc, char *argv[], int max_cpus)
 			{"affinity",         optional_argument, NULL, OPT_AFFINITY},
 			{"notrace",          no_argument,       NULL, OPT_NOTRACE },
 			{"aligned",          optional_argument, NULL, OPT_ALIGNED },
+			{"audit",            optional_argument, NULL, OPT_AUDIT },
 			{"breaktrace",       required_argument, NULL, OPT_BREAKTRACE },
 			{"preemptirqs",      no_argument,       NULL, OPT_PREEMPTIRQ },
+			{"binlog",           required_argument, NULL, OPT_BINLOG },
 			{"clock",            required_argument, NULL, OPT_CLOCK },
 			{"context",          no_argument,       NULL, OPT_CONTEXT },
+			{"deadlines",        required_argument, NULL, OPT_DEADLINES },
+			{"dl-runtime",       required_argument, NULL, OPT_DLRUNTIME },
+			{"dl-deadline",      required_argument, NULL, OPT_DLDEADLINE },
+			{"dl-period",        required_argument, NULL, OPT_DLPERIOD },
 			{"distance",         required_argument, NULL, OPT_DISTANCE },
 			{"duration",         required_argument, NULL, OPT_DURATION },
 			{"latency",          required_argument, NULL, OPT_LATENCY },
@@ -1260,12 +2734,17 @@ static void process_options (int argc, char *argv[], int max_cpus)
 			{"fifo",             required_argument, NULL, OPT_FIFO },
 			{"histogram",        required_argument, NULL, OPT_HISTOGRAM },
 			{"histofall",        required_argument, NULL, OPT_HISTOFALL },
+			{"histdigits",       required_argument, NULL, OPT_HISTDIGITS },
 			{"interval",         required_argument, NULL, OPT_INTERVAL },
 			{"irqsoff",          no_argument,       NULL, OPT_IRQSOFF },
+			{"json",             required_argument, NULL, OPT_JSON },
 			{"laptop",	     no_argument,	NULL, OPT_LAPTOP },
+			{"load",             required_argument, NULL, OPT_LOAD },
+			{"load-affinity",    required_argument, NULL, OPT_LOADAFFINITY },
 			{"loops",            required_argument, NULL, OPT_LOOPS },
 			{"mlockall",         no_argument,       NULL, OPT_MLOCKALL },
 			{"refresh_on_max",   no_argument,       NULL, OPT_REFRESH },
+			{"refresh",          required_argument, NULL, OPT_REFRESHRATE },
 			{"nanosleep",        no_argument,       NULL, OPT_NANOSLEEP },
 			{"nsecs",            no_argument,       NULL, OPT_NSECS },
 			{"oscope",           required_argument, NULL, OPT_OSCOPE },
@@ -1273,21 +2752,36 @@ static void process_options (int argc, char *argv[], int max_cpus)
 			{"priority",         required_argument, NULL, OPT_PRIORITY },
 			{"preemptoff",       no_argument,       NULL, OPT_PREEMPTOFF },
 			{"quiet",            no_argument,       NULL, OPT_QUIET },
+			{"quantiles",        no_argument,       NULL, OPT_QUANTILES },
 			{"priospread",       no_argument,       NULL, OPT_PRIOSPREAD },
+			{"recorder",         optional_argument, NULL, OPT_RECORDER },
 			{"relative",         no_argument,       NULL, OPT_RELATIVE },
 			{"resolution",       no_argument,       NULL, OPT_RESOLUTION },
 			{"secaligned",       optional_argument, NULL, OPT_SECALIGNED },
+			{"shm",              required_argument, NULL, OPT_SHM },
 			{"system",           no_argument,       NULL, OPT_SYSTEM },
 			{"smp",              no_argument,       NULL, OPT_SMP },
+			{"spikes",           optional_argument, NULL, OPT_SPIKES },
 			{"threads",          optional_argument, NULL, OPT_THREADS },
 			{"tracer",           required_argument, NULL, OPT_TRACER },
+			{"tracemark-raw",    no_argument,       NULL, OPT_TRACEMARKRAW },
+			{"timerfd",          optional_argument, NULL, OPT_TIMERFD },
+			{"tsc",              no_argument,       NULL, OPT_TSC },
 			{"unbuffered",       no_argument,       NULL, OPT_UNBUFFERED },
 			{"numa",             no_argument,       NULL, OPT_NUMA },
+			{"numa-matrix",      optional_argument, NULL, OPT_NUMAMATRIX },
 			{"verbose",          no_argument,       NULL, OPT_VERBOSE },
 			{"wakeup",           no_argument,       NULL, OPT_WAKEUP },
+			{"windows",          required_argument, NULL, OPT_WINDOWS },
+			{"window-log",       required_argument, NULL, OPT_WINDOWLOG },
+			{"window-csv",       no_argument,       NULL, OPT_WINDOWCSV },
+			{"work",             required_argument, NULL, OPT_WORK },
+			{"work-cold",        no_argument,       NULL, OPT_WORKCOLD },
+			{"work-deadline",    required_argument, NULL, OPT_WORKDEADLINE },
 			{"wakeuprt",         no_argument,       NULL, OPT_WAKEUPRT },
 			{"dbg_cyclictest",   no_argument,       NULL, OPT_DBGCYCLIC },
 			{"policy",           required_argument, NULL, OPT_POLICY },
+			{"perf",             no_argument,       NULL, OPT_PERF },
 			{"help",             no_argument,       NULL, OPT_HELP },
 			{NULL, 0, NULL, 0}
 		};
@@ -1302,11 +2796,15 @@ static void process_options (int argc, char *argv[], int max_cpus)
 			if (smp || numa)
 				break;
 			if (optarg != NULL) {
-				parse_cpumask(optarg, max_cpus);
+				affinity_mask = parse_cpumask(optarg, max_cpus);
 				setaffinity = AFFINITY_SPECIFIED;
+				strncpy(affinity_string, optarg,
+					sizeof(affinity_string) - 1);
 			} else if (optind<argc && atoi(argv[optind])) {
-				parse_cpumask(argv[optind], max_cpus);
+				affinity_mask = parse_cpumask(argv[optind], max_cpus);
 				setaffinity = AFFINITY_SPECIFIED;
+				strncpy(affinity_string, argv[optind],
+					sizeof(affinity_string) - 1);
 			} else {
 				setaffinity = AFFINITY_USEALL;
 			}
@@ -1347,8 +2845,13 @@ static void process_options (int argc, char *argv[], int max_cpus)
 			tracetype = FUNCTION; ftrace = 1; break;
 		case 'F':
 		case OPT_FIFO:
-			use_fifo = 1;
-			strncpy(fifopath, optarg, strlen(optarg));
+			if (statsock_check(optarg)) {
+				warn("stats socket path too long: %s\n", optarg);
+				error = 1;
+				break;
+			}
+			use_statsock = 1;
+			strncpy(statsock_path, optarg, sizeof(statsock_path) - 1);
 			break;
 
 		case 'H':
@@ -1504,6 +3007,114 @@ static void process_options (int argc, char *argv[], int max_cpus)
 			ct_debug = 1; break;
 		case OPT_LAPTOP:
 			laptop = 1; break;
+		case OPT_QUANTILES:
+			quantiles = 1; break;
+		case OPT_WINDOWS:
+			if (parse_windows(optarg))
+				error = 1;
+			break;
+		case OPT_WINDOWLOG:
+			strncpy(windowpath, optarg, sizeof(windowpath) - 1);
+			break;
+		case OPT_WINDOWCSV:
+			window_csv = 1; break;
+		case OPT_REFRESHRATE:
+			refresh_period = atoi(optarg); break;
+		case OPT_JSON:
+			strncpy(jsonpath, optarg, sizeof(jsonpath) - 1);
+			break;
+		case OPT_WORK:
+			if (work_parse(&work_spec, optarg))
+				fatal("invalid --work argument\n");
+			break;
+		case OPT_WORKCOLD:
+			work_cold = 1; break;
+		case OPT_WORKDEADLINE:
+			work_deadline = atoi(optarg); break;
+		case OPT_DLRUNTIME:
+			dl_runtime = atoi(optarg); break;
+		case OPT_DLDEADLINE:
+			dl_deadline = atoi(optarg); break;
+		case OPT_DLPERIOD:
+			dl_period = atoi(optarg); break;
+		case OPT_PERF:
+			use_perf = 1; break;
+		case OPT_TRACEMARKRAW:
+			tracemark_raw = 1; break;
+		case OPT_NUMAMATRIX: {
+			char *end;
+
+			numamat_lines = NUMAMAT_LINES;
+			if (optarg && *optarg != ':')
+				numamat_lines = strtoul(optarg, &end, 10);
+			else
+				end = optarg;
+			if (end && *end == ':')
+				numamat_bytes = (size_t)atoi(end + 1) << 20;
+			else if (end && *end)
+				numamat_lines = 0;
+			if (!numamat_lines || !numamat_bytes)
+				fatal("invalid --numa-matrix argument\n");
+			break;
+		}
+		case OPT_RECORDER:
+			flight_size = optarg ? atoi(optarg) : FLIGHT_SIZE;
+			if ((long)flight_size < 2)
+				fatal("invalid --recorder argument\n");
+			while (flight_size & (flight_size - 1))
+				flight_size += flight_size & -flight_size;
+			break;
+		case OPT_SPIKES:
+			spike_period = optarg ? atoi(optarg) : SPIKE_PERIOD;
+			if (spike_period < 1)
+				fatal("invalid --spikes argument\n");
+			break;
+		case OPT_AUDIT:
+			if (!optarg)
+				audit_mode = 1;
+			else if (!strcmp(optarg, "strict"))
+				audit_mode = 2;
+			else
+				fatal("invalid --audit argument\n");
+			break;
+		case OPT_LOAD:
+			if (parse_load(optarg))
+				fatal("invalid --load argument\n");
+			break;
+		case OPT_LOADAFFINITY:
+			load_mask = parse_cpumask(optarg, max_cpus);
+			break;
+		case OPT_DEADLINES:
+			deadline_count = atoi(optarg);
+			if (deadline_count < 1 || deadline_count > DEADLINES_MAX)
+				fatal("--deadlines takes 1 to %d deadlines\n",
+				      DEADLINES_MAX);
+			break;
+		case OPT_TIMERFD:
+			if (optarg)
+				timerfd_count = atoi(optarg);
+			else if (optind < argc && atoi(argv[optind]))
+				timerfd_count = atoi(argv[optind]);
+			else
+				timerfd_count = 1;
+			if (timerfd_count < 1 || timerfd_count > TIMERFD_MAX)
+				fatal("--timerfd takes 1 to %d timers\n", TIMERFD_MAX);
+			break;
+		case OPT_TSC:
+			if (!TSC_SUPPORTED)
+				fatal("--tsc is not supported on this architecture\n");
+			use_tsc = 1; break;
+		case OPT_SHM:
+			/* shm_open() wants a single leading slash */
+			snprintf(shmname, sizeof(shmname), "%s%s",
+				 optarg[0] == '/' ? "" : "/", optarg);
+			break;
+		case OPT_HISTDIGITS:
+			hist_digits = atoi(optarg); break;
+		case OPT_BINLOG:
+			use_binlog = 1;
+			strncpy(binlogpath, optarg, sizeof(binlogpath) - 1);
+			break;
 		}
 	}
 
@@ -1535,6 +3146,16 @@ static void process_options (int argc, char *argv[], int max_cpus)
 	if (histogram > HIST_MAX)
 		histogram = HIST_MAX;
 
+	if (hist_digits < HIST_DIGITS_MIN || hist_digits > HIST_DIGITS_MAX)
+		error = 1;
+
+	hist_outliers = histogram < OUTLIERS_MAX ? histogram : OUTLIERS_MAX;
+
+	if (windowpath[0] && !nr_windows) {
+		warn("--window-log needs --windows\n");
+		error = 1;
+	}
+
 	if (histogram && distance != -1)
 		warn("distance is ignored and set to 0, if histogram enabled\n");
 	if (distance == -1)
@@ -1549,6 +3170,59 @@ static void process_options (int argc, char *argv[], int max_cpus)
 		priority = num_threads+1;
 	}
 
+#ifdef __COBALT__
+	if (policy == SCHED_DEADLINE) {
+		fprintf(stderr, "SCHED_DEADLINE is a Linux policy, Cobalt threads "
+			"can not use it\n");
+		error = 1;
+	}
+	if (tracemark_raw) {
+		fprintf(stderr, "--tracemark-raw would switch the Cobalt threads "
+			"to secondary mode every cycle\n");
+		error = 1;
+	}
+	/* the counters follow the Linux scheduler, read(2) leaves primary mode */
+	if (use_perf) {
+		fprintf(stderr, "--perf counts for the Linux scheduler and would "
+			"switch the Cobalt threads to secondary mode every cycle\n");
+		error = 1;
+	}
+	/* the cpu of an unpinned thread would have to be asked from Linux */
+	if (numamat_lines && setaffinity == AFFINITY_UNSPECIFIED) {
+		fprintf(stderr, "--numa-matrix needs -a on Cobalt\n");
+		error = 1;
+	}
+#endif
+
+	if (policy == SCHED_DEADLINE) {
+		if (priority) {
+			fprintf(stderr, "SCHED_DEADLINE has no priority, ignoring -p\n");
+			priority = 0;
+			priospread = 0;
+		}
+		/* sched_setattr() refuses an affinity narrower than the root domain */
+		if (setaffinity != AFFINITY_UNSPECIFIED) {
+			fprintf(stderr, "SCHED_DEADLINE threads can not be pinned, "
+				"-a, -S and --numa can not be used with it\n");
+			error = 1;
+		}
+		if (dl_runtime < 0 || dl_deadline < 0 || dl_period < 0) {
+			error = 1;
+		} else {
+			/* check what the first thread, the shortest period, gets */
+			int period = dl_period ? dl_period : interval;
+			int deadline = dl_deadline ? dl_deadline : period;
+			int runtime = dl_runtime ? dl_runtime : deadline / 10;
+
+			if (deadline > period || runtime > deadline) {
+				fprintf(stderr, "SCHED_DEADLINE needs runtime %d <= "
+					"deadline %d <= period %d\n", runtime,
+					deadline, period);
+				error = 1;
+			}
+		}
+	}
+
 	if (priority && (policy != SCHED_FIFO && policy != SCHED_RR)) {
 		fprintf(stderr, "policy and priority don't match: setting policy to SCHED_FIFO\n");
 		policy = SCHED_FIFO;
@@ -1563,13 +3237,14 @@ static void process_options (int argc, char *argv[], int max_cpus)
 	if (num_threads < 1)
 		error = 1;
 
+	if (refresh_period < 1)
+		error = 1;
+
 	if (aligned && secaligned)
 		error = 1;
 
-	if (aligned || secaligned) {
-		barrier_init(&globalt_barr, num_threads);
-		barrier_init(&align_barr, num_threads);
-	}
+	if (aligned || secaligned)
+		barrier_init(&start_barr, num_threads);
 
 	if (error) {
 		if (affinity_mask)
@@ -1625,185 +3300,1478 @@ static int check_timer(void)
 	return (ts.tv_sec != 0 || ts.tv_nsec != 1);
 }
 
+/* Status requested by SIGUSR1, printed from the main loop */
+static void print_status(void)
+{
+	int i;
+	int oldquiet = quiet;
+
+	quiet = 0;
+	fprintf(stderr, "#---------------------------\n");
+	fprintf(stderr, "# cyclictest current status:\n");
+	for (i = 0; i < num_threads; i++)
+		print_stat(stderr, parameters[i], i, 0, 0);
+	for (i = 0; i < num_threads && flight_size; i++)
+		flight_dump(stderr, i);
+	fprintf(stderr, "#---------------------------\n");
+	quiet = oldquiet;
+}
+
 static void sighand(int sig)
 {
 	if (sig == SIGUSR1) {
-		int i;
-		int oldquiet = quiet;
+		status_requested = 1;
+		sem_post(&refresh_sem);
+		return;
+	}
+	shutdown = 1;
+	sem_post(&refresh_sem);
+	if (tracelimit && !notrace)
+		tracing(0);
+}
 
-		quiet = 0;
-		fprintf(stderr, "#---------------------------\n");
-		fprintf(stderr, "# cyclictest current status:\n");
-		for (i = 0; i < num_threads; i++)
-			print_stat(stderr, parameters[i], i, 0, 0);
-		fprintf(stderr, "#---------------------------\n");
-		quiet = oldquiet;
+/*
+ * Sleep until the next display refresh is due. With -M the display is
+ * only refreshed after a new max, but never more often than the refresh
+ * period.
+ */
+static void wait_refresh(void)
+{
+	struct timespec ts;
+
+	if (refresh_on_max) {
+		usleep(refresh_period * 1000);
+		while (sem_wait(&refresh_sem) && errno == EINTR && !shutdown)
+			;
+		return;
+	}
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += refresh_period / 1000;
+	ts.tv_nsec += (refresh_period % 1000) * 1000000;
+	tsnorm(&ts);
+	while (sem_timedwait(&refresh_sem, &ts) && errno == EINTR && !shutdown)
+		;
+}
+
+static void print_tids(struct thread_param *par[], int nthreads)
+{
+	int i;
+
+	printf("# Thread Ids:");
+	for (i = 0; i < nthreads; i++)
+		printf(" %05d", par[i]->stats->tid);
+	printf("\n");
+}
+
+static const double hist_percentiles[] = { 50.0, 99.0, 99.9, 99.999 };
+
+static void print_hist(struct thread_param *par[], int nthreads)
+{
+	int i, j;
+	unsigned int b;
+	unsigned long long int log_entries[nthreads+1];
+	unsigned long maxmax, alloverflows;
+	struct histogram all;
+	int summary = histofall && nthreads > 1;
+
+	bzero(log_entries, sizeof(log_entries));
+
+	/* merged histogram of all threads for the summary column */
+	if (summary) {
+		size_t size = hist_init(&all, histogram, hist_digits);
+
+		all.counts = calloc(1, size);
+		if (!all.counts) {
+			warn("failed to allocate the summary histogram\n");
+			summary = 0;
+		} else {
+			for (j = 0; j < nthreads; j++)
+				hist_merge(&all, &par[j]->stats->hist);
+		}
+	}
+
+	printf("# Histogram\n");
+	for (b = 0; b < par[0]->stats->hist.nbuckets; b++) {
+		printf("%06llu ", (unsigned long long)
+		       hist_bucket_low(&par[0]->stats->hist, b));
+
+		for (j = 0; j < nthreads; j++) {
+			unsigned long curr_latency=par[j]->stats->hist.counts[b];
+			printf("%06lu", curr_latency);
+			if (j < nthreads - 1)
+				printf("\t");
+			log_entries[j] += curr_latency;
+		}
+		if (summary) {
+			printf("\t%06llu", (unsigned long long)all.counts[b]);
+			log_entries[nthreads] += all.counts[b];
+		}
+		printf("\n");
+	}
+	printf("# Total:");
+	for (j = 0; j < nthreads; j++)
+		printf(" %09llu", log_entries[j]);
+	if (summary)
+		printf(" %09llu", log_entries[nthreads]);
+	printf("\n");
+	printf("# Min Latencies:");
+	for (j = 0; j < nthreads; j++)
+		printf(" %05lu", par[j]->stats->min);
+	printf("\n");
+	printf("# Avg Latencies:");
+	for (j = 0; j < nthreads; j++)
+		printf(" %05lu", par[j]->stats->cycles ?
+		       (long)(par[j]->stats->avg/par[j]->stats->cycles) : 0);
+	printf("\n");
+	printf("# Max Latencies:");
+	maxmax = 0;
+	for (j = 0; j < nthreads; j++) {
+		printf(" %05lu", par[j]->stats->max);
+		if (par[j]->stats->max > maxmax)
+			maxmax = par[j]->stats->max;
+	}
+	if (summary)
+		printf(" %05lu", maxmax);
+	printf("\n");
+	/* bucket ends may lie beyond the largest value actually seen */
+	for (i = 0; i < ARRAY_SIZE(hist_percentiles); i++) {
+		uint64_t p;
+
+		printf("# P%g Latencies:", hist_percentiles[i]);
+		for (j = 0; j < nthreads; j++) {
+			p = hist_percentile(&par[j]->stats->hist,
+					    hist_percentiles[i]);
+			if (p > par[j]->stats->max)
+				p = par[j]->stats->max;
+			printf(" %05llu", (unsigned long long)p);
+		}
+		if (summary) {
+			p = hist_percentile(&all, hist_percentiles[i]);
+			if (p > maxmax)
+				p = maxmax;
+			printf(" %05llu", (unsigned long long)p);
+		}
+		printf("\n");
+	}
+	printf("# Histogram Overflows:");
+	alloverflows = 0;
+	for (j = 0; j < nthreads; j++) {
+		printf(" %05lu", (unsigned long)par[j]->stats->hist.overflow);
+		alloverflows += par[j]->stats->hist.overflow;
+	}
+	if (summary)
+		printf(" %05lu", alloverflows);
+	printf("\n");
+
+	for (j = 0; j < nthreads; j++)
+		if (par[j]->stats->hist.early)
+			break;
+	if (j < nthreads) {
+		printf("# Histogram Early Wakeups:");
+		for (j = 0; j < nthreads; j++)
+			printf(" %05lu", (unsigned long)par[j]->stats->hist.early);
+		if (summary)
+			printf(" %05lu", (unsigned long)all.early);
+		printf("\n");
+	}
+
+	printf("# Histogram Overflow at cycle number:\n");
+	for (i = 0; i < nthreads; i++) {
+		struct thread_stat *stat = par[i]->stats;
+
+		printf("# Thread %d:", i);
+		for (j = 0; j < stat->num_outliers; j++)
+			printf(" %05lu", stat->outliers[j]);
+		if (stat->num_outliers < stat->hist.overflow)
+			printf(" # %05lu others", (unsigned long)
+			       (stat->hist.overflow - stat->num_outliers));
+		printf("\n");
+	}
+	printf("\n");
+
+	if (summary)
+		free(all.counts);
+}
+
+static void print_window(FILE *fp, int thread, int secs, struct window_stat *ws,
+			 int complete)
+{
+	const char *unit = use_nsecs ? "ns" : "us";
+
+	if (window_csv)
+		fprintf(fp, "%d,%d,%lu,%lu,%lu,%ld,%.1f,%ld,%ld,%d\n",
+			thread, secs, ws->index, ws->index * secs,
+			ws->samples, ws->min, ws->avg, ws->max, ws->p99,
+			complete);
+	else
+		fprintf(fp, "{\"thread\":%d,\"window\":%d,\"index\":%lu,"
+			"\"start\":%lu,\"samples\":%lu,\"unit\":\"%s\","
+			"\"min\":%ld,\"avg\":%.1f,\"max\":%ld,\"p99\":%ld,"
+			"\"complete\":%s}\n",
+			thread, secs, ws->index, ws->index * secs, ws->samples,
+			unit, ws->min, ws->avg, ws->max, ws->p99,
+			complete ? "true" : "false");
+}
+
+/*
+ * Write the --windows time series, oldest window first. The window
+ * still open at the end of the run is included but marked incomplete.
+ */
+static void export_windows(struct thread_param *par[], int nthreads)
+{
+	FILE *fp;
+	int i, j;
+
+	fp = fopen(windowpath, "w");
+	if (!fp) {
+		warn("unable to create %s: %s\n", windowpath, strerror(errno));
 		return;
 	}
-	shutdown = 1;
-	if (refresh_on_max)
-		pthread_cond_signal(&refresh_on_max_cond);
-	if (tracelimit && !notrace)
-		tracing(0);
+	if (window_csv)
+		fprintf(fp, "thread,window,index,start,samples,min_%s,avg_%s,"
+			"max_%s,p99_%s,complete\n",
+			use_nsecs ? "ns" : "us", use_nsecs ? "ns" : "us",
+			use_nsecs ? "ns" : "us", use_nsecs ? "ns" : "us");
+
+	for (i = 0; i < nthreads; i++) {
+		struct thread_stat *stat = par[i]->stats;
+
+		for (j = 0; j < nr_windows; j++) {
+			struct window_level *w = &stat->windows[j];
+			unsigned long k = 0;
+
+			window_drain(w);
+			if (w->closed > WINDOW_SLOTS) {
+				warn("thread %d: %lu windows of %ds lost, "
+				     "only the last %d are kept\n", i,
+				     w->closed - WINDOW_SLOTS, window_secs[j],
+				     WINDOW_SLOTS);
+				k = w->closed - WINDOW_SLOTS;
+			}
+			for (; k < w->closed; k++)
+				print_window(fp, i, window_secs[j],
+					     &w->ring[k % WINDOW_SLOTS], 1);
+
+			if (w->samples) {
+				struct window_stat ws;
+
+				ws.index = w->index;
+				ws.samples = w->samples;
+				ws.min = w->min;
+				ws.max = w->max;
+				ws.avg = w->sum / w->samples;
+				ws.p99 = window_p99(&w->hist[w->cur], w->max);
+				print_window(fp, i, window_secs[j], &ws, 0);
+			}
+		}
+	}
+	fclose(fp);
+}
+
+static void json_string(FILE *fp, const char *str)
+{
+	fputc('"', fp);
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\')
+			fprintf(fp, "\\%c", *str);
+		else if ((unsigned char)*str < 0x20)
+			fprintf(fp, "\\u%04x", *str);
+		else
+			fputc(*str, fp);
+	}
+	fputc('"', fp);
+}
+
+static const char *mode_names[] = {
+	[MODE_CYCLIC]		= "cyclic",
+	[MODE_CLOCK_NANOSLEEP]	= "clock_nanosleep",
+	[MODE_SYS_ITIMER]	= "sys_itimer",
+	[MODE_SYS_NANOSLEEP]	= "sys_nanosleep",
+	[MODE_TIMERFD]		= "timerfd",
+	[MODE_DEADLINES]	= "deadlines",
+};
+
+static const char *kernel_names[] = {
+	[KV_NOT_SUPPORTED]	= "unsupported",
+	[KV_26_LT18]		= "2.6 < 2.6.18",
+	[KV_26_LT24]		= "2.6 < 2.6.24",
+	[KV_26_33]		= "2.6.24+",
+	[KV_30]			= "3.0+",
+};
+
+/*
+ * Write the whole run as one JSON document for automated trending: the
+ * run parameters, what we found out about kernel and clock, and the
+ * per-thread results including histogram buckets and outliers.
+ */
+/* One line of counts per sample of the samples in [low, ...) */
+static void print_perf_row(int thread, const struct thread_stat *stat,
+			   uint64_t low, uint64_t samples, const uint64_t *sum)
+{
+	int k;
+
+	printf("# Thread %d perf >=%8llu: %9llu samples", thread,
+	       (unsigned long long)low, (unsigned long long)samples);
+	for (k = 0; k < PERF_EVENTS; k++)
+		if (stat->perf_events & (1 << k))
+			printf(" %s %.0f", perf_names[k],
+			       (double)sum[k] / samples);
+	printf("\n");
+}
+
+/*
+ * Counts per sample of each latency range, the buckets are summed up
+ * per power of two to keep it readable. The --json report has them
+ * all.
+ */
+static void print_perf(int thread, const struct thread_stat *stat)
+{
+	const struct histogram *h = &stat->perf_hist;
+	uint64_t sum[PERF_EVENTS], samples = 0, low = 0, blow;
+	unsigned int b;
+	int k, order = -1;
+
+	for (b = 0; b <= h->nbuckets; b++) {
+		uint64_t n = b < h->nbuckets ? h->counts[b] : h->overflow;
+		const uint64_t *s = &stat->perf_sum[b * PERF_EVENTS];
+
+		if (!n)
+			continue;
+		blow = b < h->nbuckets ? hist_bucket_low(h, b) : h->limit;
+		if (samples && (b == h->nbuckets ||
+				(blow ? 64 - __builtin_clzll(blow) : 0) != order)) {
+			print_perf_row(thread, stat, low, samples, sum);
+			samples = 0;
+		}
+		if (!samples) {
+			memset(sum, 0, sizeof(sum));
+			low = blow;
+			order = blow ? 64 - __builtin_clzll(blow) : 0;
+		}
+		samples += n;
+		for (k = 0; k < PERF_EVENTS; k++)
+			sum[k] += s[k];
+	}
+	if (samples)
+		print_perf_row(thread, stat, low, samples, sum);
+}
+
+/* {"NAME": COUNT, ...} of the busiest sources of a spike */
+static void json_sources(FILE *fp, const struct spike_source *top)
+{
+	int k;
+
+	fprintf(fp, "{");
+	for (k = 0; k < SPIKE_TOP && top[k].count; k++) {
+		fprintf(fp, "%s", k ? ", " : "");
+		json_string(fp, top[k].name);
+		fprintf(fp, ": %llu", (unsigned long long)top[k].count);
+	}
+	fprintf(fp, "}");
+}
+
+/* [bucket start, count] of the non-empty buckets of h */
+static void json_buckets(FILE *fp, const struct histogram *h)
+{
+	unsigned int b;
+	int first = 1;
+
+	fprintf(fp, "[");
+	for (b = 0; b < h->nbuckets; b++) {
+		if (!h->counts[b])
+			continue;
+		fprintf(fp, "%s[%llu, %llu]", first ? "" : ", ",
+			(unsigned long long)hist_bucket_low(h, b),
+			(unsigned long long)h->counts[b]);
+		first = 0;
+	}
+	fprintf(fp, "]");
+}
+
+/* Per thread blocks, for the placement report */
+struct mem_block {
+	const char *name;
+	const void *addr;
+	int node;		/* where it is now */
+};
+
+#define MEM_BLOCKS		13
+
+/*
+ * Ask the kernel where the blocks of a thread ended up. Returns the
+ * number of blocks, *remote is set if one is not on the intended node.
+ */
+static int mem_blocks(int i, struct mem_block *b, int *remote)
+{
+	struct thread_param *par = parameters[i];
+	struct thread_stat *stat = statistics[i];
+	const struct mem_block all[MEM_BLOCKS] = {
+		{ .name = "param", .addr = par },
+		{ .name = "stat", .addr = stat },
+		{ .name = "stack", .addr = par->stack },
+		{ .name = "hist", .addr = stat->shm ? NULL : stat->hist.counts },
+		{ .name = "outliers", .addr = stat->outliers },
+		{ .name = "ring", .addr = stat->ring.buf },
+		{ .name = "deadlines", .addr = stat->deadlines },
+		{ .name = "work", .addr = stat->exec_hist.counts },
+		{ .name = "perf", .addr = stat->perf_sum },
+		{ .name = "recorder", .addr = stat->flight },
+		{ .name = "spikes", .addr = stat->spikes },
+		{ .name = "windows", .addr = stat->windows },
+		{ .name = "numa", .addr = stat->numa_cells },
+	};
+	int j, n = 0;
+
+	*remote = 0;
+	for (j = 0; j < MEM_BLOCKS; j++) {
+		if (!all[j].addr)
+			continue;
+		b[n] = all[j];
+		b[n].node = arena_node_of(b[n].addr);
+		if (par->mem_node >= 0 && b[n].node != par->mem_node)
+			*remote = 1;
+		n++;
+	}
+	return n;
+}
+
+/* Spread of the times the threads left the start barrier */
+static int64_t start_skew(int *first, int *last)
+{
+	int i;
+
+	*first = *last = 0;
+	for (i = 1; i < num_threads; i++) {
+		if (statistics[i]->start_ns < statistics[*first]->start_ns)
+			*first = i;
+		if (statistics[i]->start_ns > statistics[*last]->start_ns)
+			*last = i;
+	}
+	return statistics[*last]->start_ns - statistics[*first]->start_ns;
+}
+
+/* One cell of the --numa-matrix, summed over the threads */
+static void numamat_sum(struct numamat_cell *sum, int cnode, int mnode)
+{
+	int i;
+
+	memset(sum, 0, sizeof(*sum));
+	for (i = 0; i < num_threads; i++) {
+		const struct numamat_cell *c =
+			&statistics[i]->numa_cells[cnode * numamat_nodes + mnode];
+
+		sum->cycles += c->cycles;
+		sum->touch_sum += c->touch_sum;
+		sum->resp_sum += c->resp_sum;
+		if (c->touch_max > sum->touch_max)
+			sum->touch_max = c->touch_max;
+		if (c->resp_max > sum->resp_max)
+			sum->resp_max = c->resp_max;
+	}
+}
+
+static void print_numamat(void)
+{
+	struct numamat_cell c;
+	int cnode, mnode, row;
+
+	printf("# NUMA matrix: %lu lines of %zu MB per node each cycle, "
+	       "ns avg/max\n", numamat_lines, numamat_bytes >> 20);
+	for (cnode = 0; cnode < numamat_nodes; cnode++) {
+		for (mnode = row = 0; mnode < numamat_nodes; mnode++) {
+			numamat_sum(&c, cnode, mnode);
+			if (!c.cycles)
+				continue;
+			if (!row++)
+				printf("# NUMA cpu node %d:", cnode);
+			printf(" mem %d", mnode);
+			if (numamat_sets[mnode].placed != mnode)
+				printf(" (on %d)", numamat_sets[mnode].placed);
+			printf(" touch %lld/%lld resp %lld/%lld",
+			       (long long)(c.touch_sum / (int64_t)c.cycles),
+			       (long long)c.touch_max,
+			       (long long)(c.resp_sum / (int64_t)c.cycles),
+			       (long long)c.resp_max);
+		}
+		if (row)
+			printf("\n");
+	}
+}
+
+static void json_memory(FILE *fp, int i)
+{
+	struct mem_block b[MEM_BLOCKS];
+	int j, remote, n = mem_blocks(i, b, &remote);
+
+	fprintf(fp, "{\"node\": %d, \"remote\": %s, \"blocks\": {",
+		parameters[i]->mem_node, remote ? "true" : "false");
+	for (j = 0; j < n; j++)
+		fprintf(fp, "%s\"%s\": %d", j ? ", " : "", b[j].name, b[j].node);
+	fprintf(fp, "}}");
+}
+
+static void write_json(struct thread_param *par[], int nthreads)
+{
+	struct utsname kname;
+	struct timespec res;
+	FILE *fp;
+	int i, j, n;
+
+	fp = fopen(jsonpath, "w");
+	if (!fp) {
+		warn("unable to create %s: %s\n", jsonpath, strerror(errno));
+		return;
+	}
+
+	fprintf(fp, "{\n  \"file_version\": 1,\n");
+	fprintf(fp, "  \"cyclictest_version\": ");
+	json_string(fp, version_string());
+	fprintf(fp, ",\n");
+
+	fprintf(fp, "  \"parameters\": {\n");
+	fprintf(fp, "    \"threads\": %d,\n", nthreads);
+	fprintf(fp, "    \"policy\": \"%s\",\n", policyname(policy));
+	fprintf(fp, "    \"priority\": %d,\n", par[0]->prio);
+	if (policy == SCHED_DEADLINE)
+		fprintf(fp, "    \"dl_runtime\": %llu,\n    \"dl_deadline\": %llu,\n"
+			"    \"dl_period\": %llu,\n",
+			(unsigned long long)par[0]->dl_runtime / 1000,
+			(unsigned long long)par[0]->dl_deadline / 1000,
+			(unsigned long long)par[0]->dl_period / 1000);
+	fprintf(fp, "    \"priospread\": %s,\n", priospread ? "true" : "false");
+	fprintf(fp, "    \"interval\": %lu,\n", par[0]->interval);
+	fprintf(fp, "    \"distance\": %d,\n", histogram ? 0 : distance);
+	fprintf(fp, "    \"clock\": \"%s\",\n",
+		clocksel ? "CLOCK_REALTIME" : "CLOCK_MONOTONIC");
+	fprintf(fp, "    \"mode\": \"%s\",\n", mode_names[par[0]->mode]);
+	fprintf(fp, "    \"timermode\": \"%s\",\n",
+		par[0]->timermode == TIMER_ABSTIME ? "absolute" : "relative");
+	fprintf(fp, "    \"unit\": \"%s\",\n", use_nsecs ? "ns" : "us");
+	fprintf(fp, "    \"loops\": %d,\n", max_cycles);
+	fprintf(fp, "    \"duration\": %d,\n", duration);
+	fprintf(fp, "    \"affinity\": ");
+	switch (setaffinity) {
+	case AFFINITY_UNSPECIFIED: fprintf(fp, "null"); break;
+	case AFFINITY_SPECIFIED: json_string(fp, affinity_string); break;
+	case AFFINITY_USEALL: fprintf(fp, "\"all\""); break;
+	}
+	fprintf(fp, ",\n");
+	fprintf(fp, "    \"numa\": %s,\n", numa ? "true" : "false");
+	fprintf(fp, "    \"mlockall\": %s,\n", lockall ? "true" : "false");
+	fprintf(fp, "    \"histogram\": %d,\n", histogram);
+	fprintf(fp, "    \"timestamps\": \"%s\",\n", use_tsc ? "tsc" : "clock");
+	if (work_spec.kind) {
+		fprintf(fp, "    \"work\": ");
+		switch (work_spec.kind) {
+		case WORK_MATVEC:
+			fprintf(fp, "\"matvec:%d\"", work_spec.size); break;
+		case WORK_MEMCPY:
+			fprintf(fp, "\"memcpy:%d\"", work_spec.size); break;
+		default:
+			json_string(fp, work_spec.arg); break;
+		}
+		fprintf(fp, ",\n    \"work_cold\": %s,\n", work_cold ? "true" : "false");
+		fprintf(fp, "    \"work_deadline\": %d,\n", work_deadline);
+	}
+	fprintf(fp, "    \"breaktrace\": %d\n", tracelimit);
+	fprintf(fp, "  },\n");
+
+	fprintf(fp, "  \"system\": {\n");
+	if (!uname(&kname)) {
+		fprintf(fp, "    \"sysname\": ");
+		json_string(fp, kname.sysname);
+		fprintf(fp, ",\n    \"release\": ");
+		json_string(fp, kname.release);
+		fprintf(fp, ",\n    \"machine\": ");
+		json_string(fp, kname.machine);
+		fprintf(fp, ",\n");
+	}
+	fprintf(fp, "    \"kernel\": \"%s\",\n", kernel_names[kernelversion]);
+	fprintf(fp, "    \"high_resolution_timers\": %s,\n",
+		hrtimers_available ? "true" : "false");
+	if (!clock_getres(clocksources[clocksel], &res))
+		fprintf(fp, "    \"clock_resolution_ns\": %llu,\n",
+			(unsigned long long)res.tv_sec * NSEC_PER_SEC + res.tv_nsec);
+	if (clock_res_measured)
+		fprintf(fp, "    \"measured_resolution_ns\": %llu,\n",
+			(unsigned long long)clock_res_measured);
+	if (use_tsc) {
+		fprintf(fp, "    \"cycle_counter_hz\": %llu,\n",
+			(unsigned long long)tsc_hz(&tsc_calib));
+		fprintf(fp, "    \"cycle_counter_read_ns\": %llu,\n",
+			(unsigned long long)tsc_read_cost);
+		fprintf(fp, "    \"clock_read_ns\": %llu,\n",
+			(unsigned long long)clock_read_cost);
+	}
+	fprintf(fp, "    \"cpus\": %ld\n", sysconf(_SC_NPROCESSORS_ONLN));
+	fprintf(fp, "  },\n");
+
+	if (audit_mode) {
+		fprintf(fp, "  \"audit\": {\n");
+		fprintf(fp, "    \"strict\": %s,\n", audit_mode > 1 ? "true" : "false");
+		fprintf(fp, "    \"sample_ms\": %d,\n", audit.sample_ms);
+		fprintf(fp, "    \"cpus\": [");
+		for (i = 0; i < audit.nr_cpus; i++) {
+			struct cpu_audit *c = &audit.cpus[i];
+
+			fprintf(fp, "%s\n      {\"cpu\": %d", i ? "," : "", c->cpu);
+			fprintf(fp, ", \"isolated\": %s, \"nohz_full\": %s, "
+				"\"rcu_nocbs\": %s, \"unbound_workqueues\": %s",
+				c->flags & (1 << AUDIT_NOT_ISOLATED) ? "false" : "true",
+				c->flags & (1 << AUDIT_NO_NOHZ_FULL) ? "false" : "true",
+				c->flags & (1 << AUDIT_NO_RCU_NOCBS) ? "false" : "true",
+				c->flags & (1 << AUDIT_WORKQUEUE) ? "true" : "false");
+			fprintf(fp, ", \"irqs\": [");
+			for (j = 0; j < c->nr_irqs && j < AUDIT_IRQS; j++)
+				fprintf(fp, "%s%d", j ? ", " : "", c->irqs[j]);
+			fprintf(fp, "], \"nr_irqs\": %d, \"softirqs\": {", c->nr_irqs);
+			for (j = 0; j < audit.nr_softirqs; j++)
+				fprintf(fp, "%s\"%s\": %llu", j ? ", " : "",
+					audit.softirq_names[j],
+					(unsigned long long)c->softirqs[j]);
+			fprintf(fp, "}}");
+		}
+		fprintf(fp, "\n    ]\n  },\n");
+	}
+
+	if (numamat_lines) {
+		struct numamat_cell c;
+		int cnode, mnode, n = 0;
+
+		fprintf(fp, "  \"numa_matrix\": {\n");
+		fprintf(fp, "    \"lines\": %lu,\n", numamat_lines);
+		fprintf(fp, "    \"set_bytes\": %zu,\n", numamat_bytes);
+		fprintf(fp, "    \"placed\": [");
+		for (mnode = 0; mnode < numamat_nodes; mnode++) {
+			if (!numamat_sets[mnode].base)
+				fprintf(fp, "%snull", mnode ? ", " : "");
+			else
+				fprintf(fp, "%s%d", mnode ? ", " : "",
+					numamat_sets[mnode].placed);
+		}
+		fprintf(fp, "],\n    \"cells\": [");
+		for (cnode = 0; cnode < numamat_nodes; cnode++)
+			for (mnode = 0; mnode < numamat_nodes; mnode++) {
+				numamat_sum(&c, cnode, mnode);
+				if (!c.cycles)
+					continue;
+				fprintf(fp, "%s\n      {\"cpu_node\": %d, \"mem_node\": %d, "
+					"\"cycles\": %lu, \"touch_avg_ns\": %lld, "
+					"\"touch_max_ns\": %lld, \"resp_avg_ns\": %lld, "
+					"\"resp_max_ns\": %lld}", n++ ? "," : "",
+					cnode, mnode, c.cycles,
+					(long long)(c.touch_sum / (int64_t)c.cycles),
+					(long long)c.touch_max,
+					(long long)(c.resp_sum / (int64_t)c.cycles),
+					(long long)c.resp_max);
+			}
+		fprintf(fp, "\n    ]\n  },\n");
+	}
+
+	if (nr_load) {
+		fprintf(fp, "  \"load\": [\n");
+		for (i = 0; i < nr_load; i++) {
+			struct load_worker *w = &load_workers[i];
+
+			fprintf(fp, "    {\"kind\": \"%s\", \"cpu\": %d, "
+				"\"duty\": %d, \"size\": %zu, \"ops\": %llu, "
+				"\"unit\": \"%s\", \"runtime_ns\": %lld, "
+				"\"failed\": %s}%s\n",
+				load_names[w->kind], w->cpu, w->duty, w->size,
+				(unsigned long long)w->ops, load_units[w->kind],
+				(long long)w->runtime, w->failed ? "true" : "false",
+				i < nr_load - 1 ? "," : "");
+		}
+		fprintf(fp, "  ],\n");
+	}
+
+	fprintf(fp, "  \"threads\": [\n");
+	for (i = 0; i < nthreads; i++) {
+		struct thread_stat *stat = par[i]->stats;
+
+		fprintf(fp, "    {\n");
+		fprintf(fp, "      \"index\": %d,\n", i);
+		fprintf(fp, "      \"tid\": %d,\n", stat->tid);
+		fprintf(fp, "      \"cpu\": %d,\n", par[i]->cpu);
+		fprintf(fp, "      \"node\": %d,\n", par[i]->node);
+		fprintf(fp, "      \"priority\": %d,\n", par[i]->prio);
+		fprintf(fp, "      \"interval\": %lu,\n", par[i]->interval);
+		fprintf(fp, "      \"cycles\": %lu,\n", stat->cycles);
+		fprintf(fp, "      \"min\": %ld,\n", stat->cycles ? stat->min : 0);
+		fprintf(fp, "      \"avg\": %.2f,\n",
+			stat->cycles ? stat->avg / stat->cycles : 0.0);
+		fprintf(fp, "      \"max\": %ld", stat->max);
+		if (verbose || use_binlog)
+			fprintf(fp, ",\n      \"samples_lost\": %lu",
+				stat->ring.overruns);
+		/* [periods skipped, cycles], the last bucket is that many or more */
+		fprintf(fp, ",\n      \"missed_periods\": %lu", stat->missed);
+		fprintf(fp, ",\n      \"missed_cycles\": %lu", stat->missed_cycles);
+		fprintf(fp, ",\n      \"missed_histogram\": [");
+		for (j = 0, n = 0; j < MISSED_BUCKETS; j++) {
+			if (!stat->missed_hist[j])
+				continue;
+			fprintf(fp, "%s[%d, %lu]", n++ ? ", " : "", j + 1,
+				stat->missed_hist[j]);
+		}
+		fprintf(fp, "]");
+		if (deadline_count) {
+			fprintf(fp, ",\n      \"deadlines\": [");
+			for (j = 0; j < deadline_count; j++) {
+				struct deadline *dl = &stat->deadlines[j];
+
+				fprintf(fp, "%s\n        {\"interval\": %lld, "
+					"\"cycles\": %lu, \"min\": %ld, "
+					"\"avg\": %.2f, \"max\": %ld}",
+					j ? "," : "", (long long)dl->period / 1000,
+					dl->cycles, dl->min,
+					dl->cycles ? dl->sum / dl->cycles : 0.0,
+					dl->max);
+			}
+			fprintf(fp, "\n      ]");
+		}
+		if (use_perf) {
+			const struct histogram *h = &stat->perf_hist;
+			unsigned int b;
+
+			/* [bucket start, samples, sum of each counter] */
+			fprintf(fp, ",\n      \"perf\": {\n        \"kernel\": %s,\n",
+				stat->perf_kernel ? "true" : "false");
+			fprintf(fp, "        \"events\": [");
+			for (j = 0, n = 0; j < PERF_EVENTS; j++)
+				if (stat->perf_events & (1 << j))
+					fprintf(fp, "%s\"%s\"", n++ ? ", " : "",
+						perf_names[j]);
+			fprintf(fp, "],\n        \"buckets\": [");
+			for (b = 0, n = 0; b <= h->nbuckets; b++) {
+				uint64_t cnt = b < h->nbuckets ? h->counts[b] : h->overflow;
+
+				if (!cnt)
+					continue;
+				fprintf(fp, "%s[%llu, %llu", n++ ? ", " : "",
+					(unsigned long long)(b < h->nbuckets ?
+						hist_bucket_low(h, b) : h->limit),
+					(unsigned long long)cnt);
+				for (j = 0; j < PERF_EVENTS; j++)
+					if (stat->perf_events & (1 << j))
+						fprintf(fp, ", %llu", (unsigned long long)
+							stat->perf_sum[b * PERF_EVENTS + j]);
+				fprintf(fp, "]");
+			}
+			fprintf(fp, "]\n      }");
+		}
+		fprintf(fp, ",\n      \"memory\": ");
+		json_memory(fp, i);
+		if (spike_period) {
+			unsigned long k;
+
+			k = stat->nr_spikes > SPIKES ? stat->nr_spikes - SPIKES : 0;
+			fprintf(fp, ",\n      \"spikes\": [");
+			for (n = 0; k < stat->nr_spikes; k++) {
+				struct spike *sp = &stat->spikes[k % SPIKES];
+
+				fprintf(fp, "%s\n        {\"cycle\": %lu, \"value\": %ld, "
+					"\"break\": %s, \"span_ns\": %lld, "
+					"\"voluntary_ctxsw\": %ld, "
+					"\"involuntary_ctxsw\": %ld,\n",
+					n++ ? "," : "", sp->cycle, sp->value,
+					sp->breach ? "true" : "false",
+					(long long)sp->span, sp->nvcsw, sp->nivcsw);
+				if (sp->missing & SPIKE_NO_IRQS)
+					fprintf(fp, "         \"irqs\": null, \"irq_top\": ");
+				else
+					fprintf(fp, "         \"irqs\": %llu, \"irq_top\": ",
+						(unsigned long long)sp->irqs);
+				json_sources(fp, sp->irq_top);
+				if (sp->missing & SPIKE_NO_SOFTIRQS)
+					fprintf(fp, ",\n         \"softirqs\": null, "
+						"\"softirq_top\": ");
+				else
+					fprintf(fp, ",\n         \"softirqs\": %llu, "
+						"\"softirq_top\": ",
+						(unsigned long long)sp->softirqs);
+				json_sources(fp, sp->softirq_top);
+				fprintf(fp, "}");
+			}
+			fprintf(fp, "\n      ]");
+		}
+		if (aligned || secaligned) {
+			int first, last;
+
+			start_skew(&first, &last);
+			fprintf(fp, ",\n      \"start_delay_ns\": %lld",
+				(long long)(stat->start_ns -
+					    statistics[first]->start_ns));
+		}
+		if (use_tsc && stat->tsc_syncs)
+			fprintf(fp, ",\n      \"tsc_offset_max_ns\": %lld"
+				",\n      \"tsc_offset_avg_ns\": %lld",
+				(long long)stat->tsc_offset_max,
+				(long long)(stat->tsc_offset_sum / stat->tsc_syncs));
+		if (histogram) {
+			fprintf(fp, ",\n      \"histogram\": {\n");
+			fprintf(fp, "        \"overflows\": %llu,\n",
+				(unsigned long long)stat->hist.overflow);
+			fprintf(fp, "        \"early_wakeups\": %llu,\n",
+				(unsigned long long)stat->hist.early);
+			fprintf(fp, "        \"outliers\": [");
+			for (j = 0; j < stat->num_outliers; j++)
+				fprintf(fp, "%s%lu", j ? ", " : "",
+					stat->outliers[j]);
+			fprintf(fp, "],\n");
+			fprintf(fp, "        \"buckets\": ");
+			json_buckets(fp, &stat->hist);
+			fprintf(fp, "\n      }");
+		}
+		if (work_spec.kind) {
+			fprintf(fp, ",\n      \"work\": {\n");
+			fprintf(fp, "        \"exec_min\": %ld,\n",
+				stat->cycles ? stat->exec_min : 0);
+			fprintf(fp, "        \"exec_avg\": %.2f,\n",
+				stat->cycles ? stat->exec_sum / stat->cycles : 0.0);
+			fprintf(fp, "        \"exec_max\": %ld,\n", stat->exec_max);
+			fprintf(fp, "        \"response_max\": %ld,\n", stat->resp_max);
+			fprintf(fp, "        \"misses\": %lu,\n", stat->misses);
+			fprintf(fp, "        \"exec_buckets\": ");
+			json_buckets(fp, &stat->exec_hist);
+			fprintf(fp, ",\n        \"response_buckets\": ");
+			json_buckets(fp, &stat->resp_hist);
+			fprintf(fp, "\n      }");
+		}
+		fprintf(fp, "\n    }%s\n", i < nthreads - 1 ? "," : "");
+	}
+	fprintf(fp, "  ],\n");
+
+	if (aligned || secaligned) {
+		int first, last;
+
+		fprintf(fp, "  \"start_skew_ns\": %lld,\n",
+			(long long)start_skew(&first, &last));
+	}
+
+	fprintf(fp, "  \"break\": ");
+	if (break_thread_id)
+		fprintf(fp, "{ \"thread\": %d, \"value\": %llu }\n",
+			break_thread_id, (unsigned long long)break_thread_value);
+	else
+		fprintf(fp, "null\n");
+	fprintf(fp, "}\n");
+
+	fclose(fp);
+}
+
+static void print_stat(FILE *fp, struct thread_param *par, int index, int verbose, int quiet)
+{
+	struct thread_stat *stat = par->stats;
+	struct stat_snapshot snap;
+
+	if (!verbose) {
+		if (quiet != 1) {
+			char *fmt;
+
+			stat_snapshot(stat, &snap);
+			if (use_nsecs)
+				fmt = "T:%2d (%5d) P:%2d I:%ld C:%7lu "
+					"Min:%7ld Act:%8ld Avg:%8ld Max:%8ld\n";
+			else
+				fmt = "T:%2d (%5d) P:%2d I:%ld C:%7lu "
+					"Min:%7ld Act:%5ld Avg:%5ld Max:%8ld\n";
+			fprintf(fp, fmt, index, stat->tid, par->prio,
+				par->interval, snap.cycles, snap.min, snap.act,
+				snap.cycles ?
+				(long)(snap.avg/snap.cycles) : 0, snap.max);
+			if (quantiles)
+				fprintf(fp, "     Win:%8ld Dev:%8.1f P99:%8ld "
+					"P99.9:%8ld P99.99:%8ld\n", snap.winmax,
+					snap.stddev, (long)snap.quant[0],
+					(long)snap.quant[1], (long)snap.quant[2]);
+		}
+	}
+}
+
+static void binlog_flush(void)
+{
+	char *p = binlog_buf;
+	ssize_t ret;
+
+	while (binlog_len) {
+		ret = write(binlog_fd, p, binlog_len);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			warn("binary log write failed: %s, logging stopped\n",
+			     strerror(errno));
+			close(binlog_fd);
+			binlog_fd = -1;
+			break;
+		}
+		p += ret;
+		binlog_len -= ret;
+	}
+	binlog_len = 0;
+}
+
+static void binlog_append(int index, struct sample *s)
+{
+	struct binlog_record *rec;
+
+	if (binlog_len + sizeof(*rec) > BINLOG_BUFSIZE)
+		binlog_flush();
+	if (binlog_fd < 0)
+		return;
+
+	rec = (struct binlog_record *)(binlog_buf + binlog_len);
+	rec->cycle = s->cycle;
+	rec->thread = index;
+	rec->flags = 0;
+	rec->value = s->value;
+	binlog_len += sizeof(*rec);
+}
+
+static int binlog_open(void)
+{
+	struct binlog_header hdr;
+
+	binlog_buf = malloc(BINLOG_BUFSIZE);
+	if (!binlog_buf)
+		return -1;
+
+	binlog_fd = open(binlogpath, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+	if (binlog_fd < 0)
+		return -1;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, BINLOG_MAGIC, sizeof(hdr.magic));
+	hdr.version = BINLOG_VERSION;
+	hdr.record_size = sizeof(struct binlog_record);
+	hdr.units = use_nsecs ? BINLOG_UNITS_NS : BINLOG_UNITS_US;
+	hdr.nthreads = num_threads;
+	hdr.interval = interval;
+	hdr.distance = histogram ? 0 : distance;
+	memcpy(binlog_buf, &hdr, sizeof(hdr));
+	binlog_len = sizeof(hdr);
+
+	return 0;
+}
+
+/*
+ * Pid of the cyclictest that created the --shm segment, 0 if the
+ * object is not a complete telemetry segment.
+ */
+static pid_t telemetry_owner(void)
+{
+	struct telemetry_header hdr;
+	int fd;
+
+	fd = shm_open(shmname, O_RDONLY, 0);
+	if (fd < 0)
+		return 0;
+	if (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+	    memcmp(hdr.magic, TELEMETRY_MAGIC, sizeof(hdr.magic)))
+		hdr.pid = 0;
+	close(fd);
+	return hdr.pid;
+}
+
+/*
+ * Create the --shm segment: header, then one cache line aligned slot
+ * per thread. The thread histograms are allocated in their slots so
+ * that readers see the live counts.
+ */
+static int telemetry_open(void)
+{
+	struct telemetry_header *hdr;
+	struct histogram h;
+	struct timespec ts;
+	unsigned int nbuckets = 0;
+	size_t header_size, slot_size;
+	void *map;
+	int fd, i;
+
+	if (histogram) {
+		hist_init(&h, histogram, hist_digits);
+		nbuckets = h.nbuckets;
+	}
+	header_size = (sizeof(*hdr) + TELEMETRY_ALIGN - 1) & ~(TELEMETRY_ALIGN - 1);
+	slot_size = telemetry_slot_size(nbuckets);
+	shm_size = header_size + num_threads * slot_size;
+
+	/*
+	 * Never take over a live segment, its readers would see it change
+	 * under them. One left behind by a cyclictest that is gone is
+	 * removed.
+	 */
+	fd = shm_open(shmname, O_RDWR|O_CREAT|O_EXCL, 0644);
+	if (fd < 0 && errno == EEXIST) {
+		pid_t pid = telemetry_owner();
+
+		if (!pid || !kill(pid, 0) || errno != ESRCH) {
+			if (pid)
+				warn("%s is in use by pid %d\n", shmname, pid);
+			else
+				warn("%s exists and is not a cyclictest segment\n",
+				     shmname);
+			errno = EEXIST;
+			return -1;
+		}
+		warn("removing %s left behind by pid %d\n", shmname, pid);
+		shm_unlink(shmname);
+		fd = shm_open(shmname, O_RDWR|O_CREAT|O_EXCL, 0644);
+	}
+	if (fd < 0)
+		return -1;
+	if (ftruncate(fd, shm_size) < 0) {
+		close(fd);
+		shm_unlink(shmname);
+		return -1;
+	}
+	map = mmap(NULL, shm_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		shm_unlink(shmname);
+		return -1;
+	}
+
+	/* the segment is fresh from ftruncate(), so all zero */
+	hdr = map;
+	hdr->version = TELEMETRY_VERSION;
+	hdr->units = use_nsecs ? TELEMETRY_UNITS_NS : TELEMETRY_UNITS_US;
+	hdr->header_size = header_size;
+	hdr->slot_size = slot_size;
+	hdr->nthreads = num_threads;
+	hdr->state = TELEMETRY_STARTING;
+	hdr->pid = getpid();
+	if (quantiles)
+		hdr->flags |= TELEMETRY_HAS_QUANTILES;
+	if (histogram) {
+		hdr->hist_sub_bits = h.sub_bits;
+		hdr->hist_nbuckets = h.nbuckets;
+		hdr->hist_limit = h.limit;
+	}
+	clock_gettime(CLOCK_REALTIME, &ts);
+	hdr->start_sec = ts.tv_sec;
+	for (i = 0; i < TELEMETRY_QUANTILES && i < NR_QUANTILES; i++)
+		hdr->quantile[i] = live_quantiles[i];
+	/* magic last, readers check it first */
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(hdr->magic, TELEMETRY_MAGIC, sizeof(hdr->magic));
+	shm_hdr = hdr;
+
+	return 0;
+}
+
+static void telemetry_close(void)
+{
+	if (!shm_hdr)
+		return;
+	munmap(shm_hdr, shm_size);
+	shm_unlink(shmname);
+	shm_hdr = NULL;
+}
+
+static void binlog_close(void)
+{
+	if (binlog_fd >= 0) {
+		binlog_flush();
+		if (binlog_fd >= 0)
+			close(binlog_fd);
+	}
+	free(binlog_buf);
+}
+
+/*
+ * Move the queued samples of one thread out of its ring,
+ * releasing the slots to the timer thread every DRAIN_BATCH samples.
+ * Only ever called from the drain thread.
+ */
+static unsigned long drain_ring(FILE *fp, struct thread_param *par, int index)
+{
+	struct thread_stat *stat = par->stats;
+	struct sample_ring *ring = &stat->ring;
+	unsigned long head, tail, n = 0;
+
+	head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	tail = ring->tail;
+
+	while (tail != head) {
+		struct sample *s = &ring->buf[tail & par->bufmsk];
+
+		if (binlog_fd >= 0)
+			binlog_append(index, s);
+
+		if (verbose) {
+			if (s->value > stat->redmax) {
+				stat->redmax = s->value;
+				stat->cycleofmax = s->cycle;
+			}
+			if (++stat->reduce == oscope_reduction) {
+				fprintf(fp, "%8d:%8lu:%8ld\n", index,
+					stat->cycleofmax, stat->redmax);
+				stat->reduce = 0;
+				stat->redmax = 0;
+			}
+		}
+		tail++;
+		if (++n % DRAIN_BATCH == 0)
+			__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+	}
+	__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+	return n;
+}
+
+/*
+ * Context switches of thread tid so far, from its status in procfs.
+ * Leaves csw alone if the thread is not (or no longer) there.
+ */
+static void spike_ctxsw(int tid, long *csw)
+{
+	char path[64], line[128];
+	FILE *fp;
+
+	if (tid <= 0)
+		return;
+	snprintf(path, sizeof(path), "/proc/self/task/%d/status", tid);
+	fp = fopen(path, "r");
+	if (!fp)
+		return;
+	while (fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, "voluntary_ctxt_switches: %ld", &csw[0]) == 1)
+			continue;
+		sscanf(line, "nonvoluntary_ctxt_switches: %ld", &csw[1]);
+	}
+	fclose(fp);
+}
+
+/* Context switch count of a thread for its --recorder rows */
+static void flight_sample(struct thread_stat *stat)
+{
+#ifdef __COBALT__
+	struct cobalt_threadstat ts;
+
+	/* a Cobalt call from a Linux thread, the timer thread is not held */
+	if (stat->tid > 0 && cobalt_thread_stat(stat->tid, &ts) == 0)
+		__atomic_store_n(&stat->flight_ctxsw, ts.csw, __ATOMIC_RELAXED);
+#else
+	long csw[2] = { -1, -1 };
+
+	spike_ctxsw(stat->tid, csw);
+	if (csw[0] >= 0 && csw[1] >= 0)
+		__atomic_store_n(&stat->flight_ctxsw, csw[0] + csw[1],
+				 __ATOMIC_RELAXED);
+#endif
+}
+
+/*
+ * thread that empties the sample rings into the verbose output and the
+ * binary log, so the timer threads neither lose samples to the display
+ * rate nor touch stdio. It also samples the context switches for the
+ * recorder, once per DRAIN_INTERVAL.
+ */
+void *drainthread(void *param)
+{
+	unsigned long drained;
+	int64_t now, sampled = 0;
+	struct timespec ts;
+	int i, j, stop;
+
+	do {
+		stop = __atomic_load_n(&drain_stop, __ATOMIC_ACQUIRE);
+		if (flight_size) {
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			now = ts_to_ns(&ts);
+			if (now - sampled >= DRAIN_INTERVAL * 1000LL) {
+				for (i = 0; i < num_threads; i++)
+					flight_sample(statistics[i]);
+				sampled = now;
+			}
+		}
+		drained = 0;
+		for (i = 0; i < num_threads; i++) {
+			drained += drain_ring(stdout, parameters[i], i);
+			for (j = 0; j < nr_windows; j++)
+				window_drain(&statistics[i]->windows[j]);
+		}
+		if (!drained && !stop)
+			usleep(DRAIN_INTERVAL);
+	} while (!stop || drained);
+
+	fflush(stdout);
+	return NULL;
+}
+
+
+/* Take the mark a timer thread left, 0 if there is none */
+static int spike_take(struct thread_stat *stat, struct spike *sp)
+{
+	unsigned int seq;
+
+	if (!__atomic_exchange_n(&stat->spike_pending, 0, __ATOMIC_ACQUIRE))
+		return 0;
+	for (;;) {
+		seq = __atomic_load_n(&stat->spike_seq, __ATOMIC_ACQUIRE);
+		if (seq & 1) {
+			sched_yield();
+			continue;
+		}
+		sp->cycle = stat->spike_cycle;
+		sp->value = stat->spike_value;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&stat->spike_seq, __ATOMIC_RELAXED) == seq)
+			break;
+	}
+	sp->breach = __atomic_exchange_n(&stat->spike_breach, 0, __ATOMIC_RELAXED);
+	return 1;
 }
 
-static void print_tids(struct thread_param *par[], int nthreads)
+/* Read one counter file, warning the first time it fails */
+static int spike_read(struct irqstat *s, const char *path)
 {
-	int i;
+	static int warned;
 
-	printf("# Thread Ids:");
-	for (i = 0; i < nthreads; i++)
-		printf(" %05d", par[i]->stats->tid);
-	printf("\n");
+	if (!irqstat_read(s, path))
+		return 0;
+	if (!__atomic_exchange_n(&warned, 1, __ATOMIC_RELAXED))
+		warn("unable to read %s, spikes go without its deltas\n", path);
+	return -1;
 }
 
-static void print_hist(struct thread_param *par[], int nthreads)
+/* Delta of each source on cpu, the busiest SPIKE_TOP go to top */
+static uint64_t spike_sources(const struct irqstat *now,
+			      const struct irqstat *then, int cpu,
+			      struct spike_source *top)
 {
-	int i, j;
-	unsigned long long int log_entries[nthreads+1];
-	unsigned long maxmax, alloverflows;
+	uint64_t d, sum = 0;
+	int r, k;
+
+	for (r = 0; r < now->nrows; r++) {
+		d = irqstat_delta(now, then, r, cpu);
+		sum += d;
+		for (k = SPIKE_TOP; k > 0 && d > top[k - 1].count; k--)
+			if (k < SPIKE_TOP)
+				top[k] = top[k - 1];
+		if (k < SPIKE_TOP) {
+			snprintf(top[k].name, IRQSTAT_NAMELEN, "%s", now->names[r]);
+			top[k].count = d;
+		}
+	}
+	return sum;
+}
 
-	bzero(log_entries, sizeof(log_entries));
+/*
+ * thread that snapshots /proc/interrupts, /proc/softirqs and the
+ * context switches of the timer threads every spike_period ms. When a
+ * timer thread marked a new max since the last snapshot, the deltas
+ * between that one and the next are kept with it. Nothing of this
+ * runs on the timer threads, they only leave the mark.
+ */
+void *spikethread(void *param)
+{
+	struct irqstat irqs[2], softirqs[2];
+	struct timespec ts[2], wait;
+	struct spike *marks;
+	long (*csw)[2];
+	int i, cur = 0, stop, *taken;
+	int missing[2] = { 0, 0 };
+
+	memset(irqs, 0, sizeof(irqs));
+	memset(softirqs, 0, sizeof(softirqs));
+	csw = calloc(2 * num_threads, sizeof(*csw));
+	marks = calloc(num_threads, sizeof(*marks));
+	taken = calloc(num_threads, sizeof(*taken));
+	if (!csw || !marks || !taken) {
+		free(csw);
+		free(marks);
+		free(taken);
+		return NULL;
+	}
+	wait.tv_sec = spike_period / 1000;
+	wait.tv_nsec = (spike_period % 1000) * 1000000L;
 
-	printf("# Histogram\n");
-	for (i = 0; i < histogram; i++) {
-		unsigned long long int allthreads = 0;
+	if (spike_read(&irqs[cur], "/proc/interrupts"))
+		missing[cur] |= SPIKE_NO_IRQS;
+	if (spike_read(&softirqs[cur], "/proc/softirqs"))
+		missing[cur] |= SPIKE_NO_SOFTIRQS;
+	for (i = 0; i < num_threads; i++)
+		spike_ctxsw(statistics[i]->tid, csw[cur * num_threads + i]);
+	clock_gettime(CLOCK_MONOTONIC, &ts[cur]);
 
-		printf("%06d ", i);
+	do {
+		int next = !cur;
 
-		for (j = 0; j < nthreads; j++) {
-			unsigned long curr_latency=par[j]->stats->hist_array[i];
-			printf("%06lu", curr_latency);
-			if (j < nthreads - 1)
-				printf("\t");
-			log_entries[j] += curr_latency;
-			allthreads += curr_latency;
+		stop = __atomic_load_n(&spike_stop, __ATOMIC_ACQUIRE);
+		if (!stop)
+			clock_nanosleep(CLOCK_MONOTONIC, 0, &wait, NULL);
+
+		/*
+		 * Only the marks left before the next snapshot starts are
+		 * sure to lie inside it, later ones wait for the one after.
+		 */
+		for (i = 0; i < num_threads; i++)
+			taken[i] = spike_take(statistics[i], &marks[i]);
+
+		missing[next] = 0;
+		if (spike_read(&irqs[next], "/proc/interrupts"))
+			missing[next] |= SPIKE_NO_IRQS;
+		if (spike_read(&softirqs[next], "/proc/softirqs"))
+			missing[next] |= SPIKE_NO_SOFTIRQS;
+		for (i = 0; i < num_threads; i++) {
+			csw[next * num_threads + i][0] = csw[cur * num_threads + i][0];
+			csw[next * num_threads + i][1] = csw[cur * num_threads + i][1];
+			spike_ctxsw(statistics[i]->tid, csw[next * num_threads + i]);
 		}
-		if (histofall && nthreads > 1) {
-			printf("\t%06llu", allthreads);
-			log_entries[nthreads] += allthreads;
+		clock_gettime(CLOCK_MONOTONIC, &ts[next]);
+
+		for (i = 0; i < num_threads; i++) {
+			struct thread_stat *stat = statistics[i];
+			long *now = csw[next * num_threads + i];
+			long *then = csw[cur * num_threads + i];
+			struct spike *sp;
+
+			if (!taken[i])
+				continue;
+			sp = &stat->spikes[stat->nr_spikes % SPIKES];
+			memset(sp, 0, sizeof(*sp));
+			sp->cycle = marks[i].cycle;
+			sp->value = marks[i].value;
+			sp->breach = marks[i].breach;
+			sp->missing = missing[cur] | missing[next];
+			sp->span = calcdiff_ns(ts[next], ts[cur]);
+			if (!(sp->missing & SPIKE_NO_IRQS))
+				sp->irqs = spike_sources(&irqs[next], &irqs[cur],
+							 parameters[i]->cpu,
+							 sp->irq_top);
+			if (!(sp->missing & SPIKE_NO_SOFTIRQS))
+				sp->softirqs = spike_sources(&softirqs[next],
+							     &softirqs[cur],
+							     parameters[i]->cpu,
+							     sp->softirq_top);
+			/* a thread that only just started has no baseline */
+			if (then[0] || then[1]) {
+				sp->nvcsw = now[0] - then[0];
+				sp->nivcsw = now[1] - then[1];
+			}
+			stat->nr_spikes++;
 		}
-		printf("\n");
-	}
-	printf("# Total:");
-	for (j = 0; j < nthreads; j++)
-		printf(" %09llu", log_entries[j]);
-	if (histofall && nthreads > 1)
-		printf(" %09llu", log_entries[nthreads]);
-	printf("\n");
-	printf("# Min Latencies:");
-	for (j = 0; j < nthreads; j++)
-		printf(" %05lu", par[j]->stats->min);
-	printf("\n");
-	printf("# Avg Latencies:");
-	for (j = 0; j < nthreads; j++)
-		printf(" %05lu", par[j]->stats->cycles ?
-		       (long)(par[j]->stats->avg/par[j]->stats->cycles) : 0);
-	printf("\n");
-	printf("# Max Latencies:");
-	maxmax = 0;
-	for (j = 0; j < nthreads; j++) {
-		printf(" %05lu", par[j]->stats->max);
-		if (par[j]->stats->max > maxmax)
-			maxmax = par[j]->stats->max;
-	}
-	if (histofall && nthreads > 1)
-		printf(" %05lu", maxmax);
-	printf("\n");
-	printf("# Histogram Overflows:");
-	alloverflows = 0;
-	for (j = 0; j < nthreads; j++) {
-		printf(" %05lu", par[j]->stats->hist_overflow);
-		alloverflows += par[j]->stats->hist_overflow;
-	}
-	if (histofall && nthreads > 1)
-		printf(" %05lu", alloverflows);
-	printf("\n");
+		cur = next;
+	} while (!stop);
 
-	printf("# Histogram Overflow at cycle number:\n");
-	for (i = 0; i < nthreads; i++) {
-		printf("# Thread %d:", i);
-		for (j = 0; j < par[i]->stats->num_outliers; j++)
-			printf(" %05lu", par[i]->stats->outliers[j]);
-		if (par[i]->stats->num_outliers < par[i]->stats->hist_overflow)
-			printf(" # %05lu others", par[i]->stats->hist_overflow - par[i]->stats->num_outliers);
-		printf("\n");
+	for (i = 0; i < 2; i++) {
+		irqstat_free(&irqs[i]);
+		irqstat_free(&softirqs[i]);
 	}
-	printf("\n");
+	free(taken);
+	free(marks);
+	free(csw);
+	return NULL;
 }
 
-static void print_stat(FILE *fp, struct thread_param *par, int index, int verbose, int quiet)
+/* One spike as "NAME COUNT, ..." of its busiest sources */
+static void spike_print_top(FILE *fp, const struct spike_source *top)
 {
-	struct thread_stat *stat = par->stats;
+	int k;
 
-	if (!verbose) {
-		if (quiet != 1) {
-			char *fmt;
-			if (use_nsecs)
-				fmt = "T:%2d (%5d) P:%2d I:%ld C:%7lu "
-					"Min:%7ld Act:%8ld Avg:%8ld Max:%8ld\n";
-			else
-				fmt = "T:%2d (%5d) P:%2d I:%ld C:%7lu "
-					"Min:%7ld Act:%5ld Avg:%5ld Max:%8ld\n";
-			fprintf(fp, fmt, index, stat->tid, par->prio,
-				par->interval, stat->cycles, stat->min, stat->act,
-				stat->cycles ?
-				(long)(stat->avg/stat->cycles) : 0, stat->max);
-		}
-	} else {
-		while (stat->cycles != stat->cyclesread) {
-			long diff = stat->values
-			    [stat->cyclesread & par->bufmsk];
-
-			if (diff > stat->redmax) {
-				stat->redmax = diff;
-				stat->cycleofmax = stat->cyclesread;
-			}
-			if (++stat->reduce == oscope_reduction) {
-				fprintf(fp, "%8d:%8lu:%8ld\n", index,
-					stat->cycleofmax, stat->redmax);
-				stat->reduce = 0;
-				stat->redmax = 0;
-			}
-			stat->cyclesread++;
-		}
-	}
+	for (k = 0; k < SPIKE_TOP && top[k].count; k++)
+		fprintf(fp, "%s%s %llu", k ? ", " : " (", top[k].name,
+			(unsigned long long)top[k].count);
+	if (k)
+		fprintf(fp, ")");
 }
 
+/* Write one status snapshot of all threads to a stats client */
+static int stats_send(int fd, FILE *fp, char *buf)
+{
+	long len;
+	int i;
+
+	rewind(fp);
+	for (i = 0; i < num_threads; i++)
+		print_stat(fp, parameters[i], i, 0, 0);
+	fflush(fp);
+	len = ftell(fp);
+
+	/* a client which does not keep up is dropped, never waited for */
+	return statsock_send(fd, buf, len);
+}
 
 /*
- * thread that creates a named fifo and hands out run stats when someone
- * reads from the fifo.
+ * thread that serves run stats on a unix domain socket. Every client
+ * gets a snapshot when it connects and another one for every request
+ * it sends afterwards, e.g. a newline. The snapshots are taken through
+ * the thread_stat seqlocks, so the timer threads are not involved and
+ * nothing is allocated per request.
  */
-void *fifothread(void *param)
+void *statsthread(void *param)
 {
-	int ret;
-	int fd;
+	struct pollfd pfd[STATS_CLIENTS + 1];
+	char req[64];
+	size_t size;
+	char *buf;
 	FILE *fp;
-	int i;
-
-	if (use_fifo == 0)
+	int i, fd;
+
+	size = (num_threads * (quantiles ? 2 : 1) + 1) * DISPLAY_LINE;
+	buf = malloc(size);
+	fp = buf ? fmemopen(buf, size, "w") : NULL;
+	if (!fp) {
+		fprintf(stderr, "Error allocating the stats buffer\n");
+		free(buf);
 		return NULL;
+	}
 
-	unlink(fifopath);
-	ret = mkfifo(fifopath, 0666);
-	if (ret) {
-		fprintf(stderr, "Error creating fifo %s: %s\n", fifopath, strerror(errno));
+	fd = statsock_listen(statsock_path, STATS_CLIENTS);
+	if (fd < 0) {
+		fprintf(stderr, "Error creating stats socket %s: %s\n", statsock_path, strerror(errno));
+		fclose(fp);
+		free(buf);
 		return NULL;
 	}
+
+	pfd[0].fd = fd;
+	pfd[0].events = POLLIN;
+	for (i = 1; i <= STATS_CLIENTS; i++) {
+		pfd[i].fd = -1;
+		pfd[i].events = POLLIN;
+	}
+
 	while (!shutdown) {
-		fd = open(fifopath, O_WRONLY|O_NONBLOCK);
-		if (fd < 0) {
-			usleep(500000);
+		/* wake up now and then to notice the shutdown */
+		if (poll(pfd, STATS_CLIENTS + 1, 100) <= 0)
 			continue;
+
+		for (i = 1; i <= STATS_CLIENTS; i++) {
+			if (pfd[i].fd < 0 || !pfd[i].revents)
+				continue;
+			if (!(pfd[i].revents & POLLIN) ||
+			    read(pfd[i].fd, req, sizeof(req)) <= 0 ||
+			    stats_send(pfd[i].fd, fp, buf)) {
+				close(pfd[i].fd);
+				pfd[i].fd = -1;
+			}
+		}
+
+		if (pfd[0].revents & POLLIN) {
+			int cfd = statsock_accept(fd);
+
+			if (cfd < 0)
+				continue;
+			for (i = 1; i <= STATS_CLIENTS; i++)
+				if (pfd[i].fd < 0)
+					break;
+			if (i > STATS_CLIENTS || stats_send(cfd, fp, buf)) {
+				close(cfd);
+				continue;
+			}
+			pfd[i].fd = cfd;
 		}
-		fp = fdopen(fd, "w");
-		for (i=0; i < num_threads; i++)
-			print_stat(fp, parameters[i], i, 0, 0);
-		fclose(fp);
-		usleep(250);
 	}
-	unlink(fifopath);
+
+	for (i = 0; i <= STATS_CLIENTS; i++)
+		if (pfd[i].fd >= 0)
+			close(pfd[i].fd);
+	unlink(statsock_path);
+	fclose(fp);
+	free(buf);
 	return NULL;
 }
 
@@ -1814,7 +4782,12 @@ int main(int argc, char **argv)
 	int signum = SIGALRM;
 	int mode;
 	int max_cpus = sysconf(_SC_NPROCESSORS_ONLN);
-	int i, ret = -1;
+	int i, j, ret = -1;
+	FILE *disp_fp = NULL;
+	char *disp_buf = NULL;
+	size_t disp_size;
+	int disp_lines = 0, refreshes = 0;
+	int loadavg_fd = -1;
 	int status;
 
 	process_options(argc, argv, max_cpus);
@@ -1828,6 +4801,19 @@ int main(int argc, char **argv)
 	/* Checks if numa is on, program exits if numa on but not available */
 	numa_on_and_available();
 
+	/*
+	 * Workers which fork get their helper process now, while little
+	 * is mapped and nothing is locked yet.
+	 */
+	for (i = 0; i < nr_load; i++) {
+		if (load_mask)
+			load_workers[i].cpu = cpu_for_thread(i, max_cpus, load_mask);
+		if (load_workers[i].kind == LOAD_FORK &&
+		    load_spawn(&load_workers[i]))
+			fatal("failed to fork load worker %d: %s\n", i,
+			      strerror(errno));
+	}
+
 	/* lock all memory (prevent swapping) */
 	if (lockall)
 		if (mlockall(MCL_CURRENT|MCL_FUTURE) == -1) {
@@ -1835,6 +4821,31 @@ int main(int argc, char **argv)
 			goto out;
 		}
 
+	/* the working sets, before the threads allocate their own memory */
+	if (numamat_lines) {
+		numamat_nodes = rt_numa_node_count();
+		for (i = 0; i < CPU_SETSIZE; i++) {
+			int n = arena_node_of_cpu(i);
+
+			numamat_cpu_node[i] = n >= 0 && n < numamat_nodes ? n : 0;
+		}
+		numamat_sets = calloc(numamat_nodes, sizeof(*numamat_sets));
+		if (!numamat_sets ||
+		    numamat_init(numamat_sets, numamat_nodes, numamat_bytes,
+				 num_threads))
+			fatal("failed to place the --numa-matrix working sets: %s\n",
+			      strerror(errno));
+		numamat_walk = calloc(numamat_nodes, sizeof(*numamat_walk));
+		if (!numamat_walk)
+			fatal("failed to place the --numa-matrix working sets: %s\n",
+			      strerror(errno));
+		for (i = 0; i < numamat_nodes; i++)
+			if (numamat_sets[i].base)
+				numamat_walk[numamat_walk_nodes++] = i;
+		if (!numamat_walk_nodes)
+			fatal("--numa-matrix found no online memory node\n");
+	}
+
 	/* use the /dev/cpu_dma_latency trick if it's there */
 	set_latency_target();
 
@@ -1845,7 +4856,17 @@ int main(int argc, char **argv)
 
 	setup_tracer();
 
-	if (check_timer())
+	if (tracemark_raw) {
+		if (mount_debugfs(NULL))
+			fatal("could not mount debugfs");
+		strcat(strcpy(tracemark_raw_path, get_debugfileprefix()),
+		       "trace_marker_raw");
+		if (access(tracemark_raw_path, W_OK))
+			fatal("%s: %s\n", tracemark_raw_path, strerror(errno));
+	}
+
+	hrtimers_available = !check_timer();
+	if (!hrtimers_available)
 		warn("High resolution timers not available\n");
 
 	if (check_clock_resolution) {
@@ -1929,6 +4950,8 @@ int main(int argc, char **argv)
 
 		free(time);
 
+		if (min_non_zero_diff != UINT64_MAX)
+			clock_res_measured = min_non_zero_diff;
 
 		if (verbose ||
 		    (min_non_zero_diff && (min_non_zero_diff > reported_resolution))) {
@@ -1945,26 +4968,75 @@ int main(int argc, char **argv)
 
 	}
 
+	if (use_tsc) {
+		struct timespec t0, t1, now;
+		int k;
+
+		if (tsc_calibrate(&tsc_calib, clocksources[clocksel], TSC_CALIBRATE))
+			fatal("unable to calibrate the cycle counter: %s\n",
+			      strerror(errno));
+
+		/* what each timestamp source costs per sample */
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		for (k = 0; k < 1000; k++)
+			tsc_read();
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		tsc_read_cost = calcdiff_ns(t1, t0) / 1000;
+		for (k = 0; k < 1000; k++)
+			clock_gettime(clocksources[clocksel], &now);
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		clock_read_cost = calcdiff_ns(t0, t1) / 1000;
+	}
+
 	mode = use_nanosleep + use_system;
+	if (timerfd_count && deadline_count)
+		fatal("--timerfd and --deadlines are mutually exclusive\n");
+	if (timerfd_count || deadline_count) {
+		if (mode != MODE_CYCLIC)
+			warn("--timerfd and --deadlines override -n and -s\n");
+		mode = timerfd_count ? MODE_TIMERFD : MODE_DEADLINES;
+	}
+
+	/* before the load starts, it would only add to the softirqs */
+	if (audit_mode)
+		audit_check(max_cpus);
 
 	sigemptyset(&sigset);
 	sigaddset(&sigset, signum);
 	sigprocmask (SIG_BLOCK, &sigset, NULL);
 
+	sem_init(&refresh_sem, 0, 0);
+
 	signal(SIGINT, sighand);
 	signal(SIGTERM, sighand);
 	signal(SIGUSR1, sighand);
 
+	if (use_binlog && binlog_open())
+		fatal("unable to create binary log %s: %s\n", binlogpath,
+		      strerror(errno));
+
+	if (shmname[0] && telemetry_open())
+		fatal("unable to create shared memory object %s: %s\n",
+		      shmname, strerror(errno));
+
+	/* the load runs from before the first until after the last sample */
+	for (i = 0; i < nr_load; i++) {
+		if (load_start(&load_workers[i]))
+			fatal("failed to start load worker %d: %s\n", i,
+			      strerror(errno));
+	}
+
 	parameters = calloc(num_threads, sizeof(struct thread_param *));
 	if (!parameters)
 		goto out;
 	statistics = calloc(num_threads, sizeof(struct thread_stat *));
 	if (!statistics)
-		goto outpar;
+		goto out;
 
 	for (i = 0; i < num_threads; i++) {
 		pthread_attr_t attr;
-		int node;
+		int node, cpu = -1;
+		void *stack = NULL;
 		struct thread_param *par;
 		struct thread_stat *stat;
 
@@ -1972,14 +5044,21 @@ int main(int argc, char **argv)
 		if (status != 0)
 			fatal("error from pthread_attr_init for thread %d: %s\n", i, strerror(status));
 
-		node = -1;
+		/* the memory of the thread goes to the node of its cpu */
+		switch (setaffinity) {
+		case AFFINITY_UNSPECIFIED: break;
+		case AFFINITY_SPECIFIED:
+			cpu = cpu_for_thread(i, max_cpus, affinity_mask);
+			break;
+		case AFFINITY_USEALL: cpu = i % max_cpus; break;
+		}
+		node = arena_node_of_cpu(cpu);
+
 		if (numa) {
-			void *stack;
 			void *currstk;
 			size_t stksize;
 
-			/* find the memory node associated with the cpu i */
-			node = rt_numa_numa_node_of_cpu(i);
+			node = rt_numa_numa_node_of_cpu(cpu);
 
 			/* get the stack size set for for this thread */
 			if (pthread_attr_getstack(&attr, &currstk, &stksize))
@@ -1990,7 +5069,10 @@ int main(int argc, char **argv)
 				stksize = PTHREAD_STACK_MIN * 2;
 
 			/*  allocate memory for a stack on appropriate node */
-			stack = rt_numa_numa_alloc_onnode(stksize, node, i);
+			stack = threadalloc(stksize, node);
+			if (!stack)
+				fatal("failed to allocate %zu bytes on node %d for cpu %d\n",
+				      stksize, node, cpu);
 
 			/* set the thread's stack */
 			if (pthread_attr_setstack(&attr, stack, stksize))
@@ -2009,32 +5091,40 @@ int main(int argc, char **argv)
 		if (stat == NULL)
 			fatal("error allocating thread status struct for thread %d\n", i);
 		memset(stat, 0, sizeof(struct thread_stat));
+		if (shm_hdr)
+			stat->shm = telemetry_slot(shm_hdr, i);
 
 		/* allocate the histogram if requested */
 		if (histogram) {
-			int bufsize = histogram * sizeof(long);
+			size_t bufsize = hist_init(&stat->hist, histogram, hist_digits);
+			size_t outsize = hist_outliers * sizeof(long);
 
-			stat->hist_array = threadalloc(bufsize, node);
-			stat->outliers = threadalloc(bufsize, node);
-			if (stat->hist_array == NULL || stat->outliers == NULL)
+			if (stat->shm)
+				stat->hist.counts = stat->shm->counts;
+			else
+				stat->hist.counts = threadalloc(bufsize, node);
+			stat->outliers = threadalloc(outsize, node);
+			if (stat->hist.counts == NULL || stat->outliers == NULL)
 				fatal("failed to allocate histogram of size %d on node %d\n",
 				      histogram, i);
-			memset(stat->hist_array, 0, bufsize);
-			memset(stat->outliers, 0, bufsize);
+			memset(stat->hist.counts, 0, bufsize);
+			memset(stat->outliers, 0, outsize);
 		}
 
-		if (verbose) {
-			int bufsize = VALBUF_SIZE * sizeof(long);
-			stat->values = threadalloc(bufsize, node);
-			if (!stat->values)
+		if (verbose || use_binlog) {
+			int bufsize = VALBUF_SIZE * sizeof(struct sample);
+			stat->ring.buf = threadalloc(bufsize, node);
+			if (!stat->ring.buf)
 				goto outall;
-			memset(stat->values, 0, bufsize);
+			memset(stat->ring.buf, 0, bufsize);
 			par->bufmsk = VALBUF_SIZE - 1;
 		}
 
 		par->prio = priority;
 		if (priority && (policy == SCHED_FIFO || policy == SCHED_RR))
 			par->policy = policy;
+		else if (policy == SCHED_DEADLINE)
+			par->policy = policy;
 		else {
 			par->policy = SCHED_OTHER;
 			force_sched_other = 1;
@@ -2044,41 +5134,169 @@ int main(int argc, char **argv)
 		par->clock = clocksources[clocksel];
 		par->mode = mode;
 		par->timermode = timermode;
+		par->timers = timerfd_count;
+		par->deadlines = deadline_count;
 		par->signal = signum;
 		par->interval = interval;
+		if (policy == SCHED_DEADLINE) {
+			/* period and deadline follow the interval, 10% runtime */
+			par->dl_period = (uint64_t)(dl_period ? dl_period : interval) * 1000;
+			par->dl_deadline = dl_deadline ?
+				(uint64_t)dl_deadline * 1000 : par->dl_period;
+			par->dl_runtime = dl_runtime ?
+				(uint64_t)dl_runtime * 1000 : par->dl_deadline / 10;
+		}
 		if (!histogram) /* same interval on CPUs */
 			interval += distance;
+		if (stat->shm) {
+			stat->shm->prio = par->prio;
+			stat->shm->interval = par->interval;
+		}
 		if (verbose)
 			printf("Thread %d Interval: %d\n", i, interval);
 		par->max_cycles = max_cycles;
 		par->stats = stat;
-		par->node = node;
+		par->node = numa ? node : -1;
+		par->mem_node = node;
+		par->stack = stack;
 		par->tnum = i;
-		switch (setaffinity) {
-		case AFFINITY_UNSPECIFIED: par->cpu = -1; break;
-		case AFFINITY_SPECIFIED:
-			par->cpu = cpu_for_thread(i, max_cpus);
-			if (verbose)
-				printf("Thread %d using cpu %d.\n", i,
-					par->cpu);
-			break;
-		case AFFINITY_USEALL: par->cpu = i % max_cpus; break;
-		}
+		par->cpu = cpu;
+		if (verbose && setaffinity == AFFINITY_SPECIFIED)
+			printf("Thread %d using cpu %d.\n", i, par->cpu);
 		stat->min = 1000000;
 		stat->max = 0;
 		stat->avg = 0.0;
+		for (j = 0; j < NR_QUANTILES; j++)
+			p2_init(&stat->quant[j], live_quantiles[j]);
+
+		if (deadline_count) {
+			stat->deadlines = threadalloc(deadline_count * sizeof(struct deadline), node);
+			stat->dlheap = threadalloc(deadline_count * sizeof(struct deadline *), node);
+			if (!stat->deadlines || !stat->dlheap)
+				fatal("failed to allocate deadlines for thread %d\n", i);
+			memset(stat->deadlines, 0, deadline_count * sizeof(struct deadline));
+			for (j = 0; j < deadline_count; j++)
+				stat->deadlines[j].period =
+					((int64_t)par->interval + j * distance) * 1000;
+		}
+
+		if (work_spec.kind) {
+			uint64_t limit = use_nsecs ? NSEC_PER_SEC : USEC_PER_SEC;
+			size_t size = hist_init(&stat->exec_hist, limit, hist_digits);
+
+			hist_init(&stat->resp_hist, limit, hist_digits);
+			stat->exec_hist.counts = threadalloc(size, node);
+			stat->resp_hist.counts = threadalloc(size, node);
+			if (!stat->exec_hist.counts || !stat->resp_hist.counts)
+				fatal("failed to allocate work histograms for thread %d\n", i);
+			memset(stat->exec_hist.counts, 0, size);
+			memset(stat->resp_hist.counts, 0, size);
+			stat->exec_min = LONG_MAX;
+		}
+
+		if (use_perf) {
+			uint64_t limit = use_nsecs ? NSEC_PER_SEC : USEC_PER_SEC;
+			size_t size = hist_init(&stat->perf_hist, limit, HIST_DIGITS_MIN);
+			size_t sums = (stat->perf_hist.nbuckets + 1) * PERF_EVENTS *
+				sizeof(uint64_t);
+
+			stat->perf_hist.counts = threadalloc(size, node);
+			stat->perf_sum = threadalloc(sums, node);
+			if (!stat->perf_hist.counts || !stat->perf_sum)
+				fatal("failed to allocate counters for thread %d\n", i);
+			memset(stat->perf_hist.counts, 0, size);
+			memset(stat->perf_sum, 0, sums);
+		}
+
+		if (flight_size) {
+			stat->flight = threadalloc(flight_size * sizeof(struct flight), node);
+			if (!stat->flight)
+				fatal("failed to allocate the recorder for thread %d\n", i);
+			memset(stat->flight, 0, flight_size * sizeof(struct flight));
+		}
+
+		if (numamat_lines) {
+			stat->numa_cells = threadalloc(numamat_nodes * numamat_nodes *
+						       sizeof(struct numamat_cell), node);
+			stat->numa_pos = threadalloc(numamat_nodes * sizeof(void *), node);
+			if (!stat->numa_cells || !stat->numa_pos)
+				fatal("failed to allocate the numa matrix for thread %d\n", i);
+			for (j = 0; j < numamat_nodes; j++)
+				stat->numa_pos[j] = numamat_sets[j].base ?
+					numamat_sets[j].start[i] : NULL;
+		}
+
+		if (spike_period) {
+			stat->spikes = threadalloc(SPIKES * sizeof(struct spike), node);
+			if (!stat->spikes)
+				fatal("failed to allocate spikes for thread %d\n", i);
+		}
+
+		/* window rollups are kept on the thread's node as well */
+		if (nr_windows) {
+			stat->windows = threadalloc(nr_windows * sizeof(struct window_level), node);
+			if (!stat->windows)
+				fatal("failed to allocate windows for thread %d\n", i);
+			for (j = 0; j < nr_windows; j++) {
+				struct window_level *w = &stat->windows[j];
+				size_t size = hist_init(&w->hist[0], use_nsecs ?
+							NSEC_PER_SEC : USEC_PER_SEC,
+							WINDOW_DIGITS);
+
+				w->hist[1] = w->hist[0];
+				w->hist[0].counts = threadalloc(size, node);
+				w->hist[1].counts = threadalloc(size, node);
+				w->ring = threadalloc(WINDOW_SLOTS * sizeof(struct window_stat), node);
+				if (!w->hist[0].counts || !w->hist[1].counts || !w->ring)
+					fatal("failed to allocate windows for thread %d\n", i);
+			}
+		}
 		stat->threadstarted = 1;
 		status = pthread_create(&stat->thread, &attr, timerthread, par);
 		if (status)
 			fatal("failed to create thread %d: %s\n", i, strerror(status));
 
 	}
-	if (use_fifo)
-		status = pthread_create(&fifo_threadid, NULL, fifothread, NULL);
+	if (use_statsock) {
+		status = pthread_create(&statsock_threadid, NULL, statsthread, NULL);
+		if (status)
+			fatal("failed to create stats thread: %s\n", strerror(status));
+		statsock_started = 1;
+	}
+	if (spike_period) {
+		status = pthread_create(&spike_threadid, NULL, spikethread, NULL);
+		if (status)
+			fatal("failed to create spike thread: %s\n", strerror(status));
+		spike_started = 1;
+	}
+	if (verbose || use_binlog || nr_windows || flight_size) {
+		status = pthread_create(&drain_threadid, NULL, drainthread, NULL);
+		if (status)
+			fatal("failed to create drain thread: %s\n", strerror(status));
+		drain_started = 1;
+	}
+	if (shm_hdr)
+		__atomic_store_n(&shm_hdr->state, TELEMETRY_RUNNING, __ATOMIC_RELEASE);
+
+	/*
+	 * The status display is formatted into one buffer and written with
+	 * a single write() per refresh, /proc/loadavg stays open.
+	 */
+	if (!verbose && !quiet) {
+		disp_lines = num_threads * (quantiles ? 2 : 1) + 2;
+		disp_size = (disp_lines + 2) * DISPLAY_LINE;
+		disp_buf = malloc(disp_size);
+		if (disp_buf)
+			disp_fp = fmemopen(disp_buf, disp_size, "w");
+		if (!disp_fp)
+			fatal("unable to allocate the display buffer\n");
+		loadavg_fd = open("/proc/loadavg", O_RDONLY);
+		fflush(stdout);
+	}
 
 	while (!shutdown) {
 		char lavg[256];
-		int fd, len, allstopped = 0;
+		int len, allstopped = 0;
 		static char *policystr = NULL;
 		static char *slash = NULL;
 		static char *policystr2;
@@ -2093,34 +5311,41 @@ int main(int argc, char **argv)
 			} else
 				slash = policystr2 = "";
 		}
-		if (!verbose && !quiet) {
-			fd = open("/proc/loadavg", O_RDONLY, 0666);
-			len = read(fd, &lavg, 255);
-			close(fd);
-			lavg[len-1] = 0x0;
-			printf("policy: %s%s%s: loadavg: %s          \n\n",
-			       policystr, slash, policystr2, lavg);
+		__atomic_store_n(&refresh_pending, 0, __ATOMIC_RELEASE);
+
+		if (status_requested) {
+			status_requested = 0;
+			print_status();
 		}
 
-		for (i = 0; i < num_threads; i++) {
+		if (disp_fp) {
+			rewind(disp_fp);
+			if (refreshes++)
+				fprintf(disp_fp, "\033[%dA", disp_lines);
+			len = loadavg_fd >= 0 ?
+				pread(loadavg_fd, lavg, sizeof(lavg) - 1, 0) : 0;
+			lavg[len > 0 ? len - 1 : 0] = 0x0;
+			fprintf(disp_fp, "policy: %s%s%s: loadavg: %s          \n\n",
+				policystr, slash, policystr2, lavg);
+			for (i = 0; i < num_threads; i++)
+				print_stat(disp_fp, parameters[i], i, 0, quiet);
+			fflush(disp_fp);
+			write_check(STDOUT_FILENO, disp_buf, ftell(disp_fp));
+		}
 
-			print_stat(stdout, parameters[i], i, verbose, quiet);
-			if(max_cycles && statistics[i]->cycles >= max_cycles)
+		for (i = 0; i < num_threads; i++) {
+			if(max_cycles && __atomic_load_n(&statistics[i]->cycles,
+					__ATOMIC_RELAXED) >= max_cycles)
 				allstopped++;
 		}
 
-		usleep(10000);
+		/* the next window max starts with the next sample */
+		if (quantiles)
+			__atomic_add_fetch(&stat_window, 1, __ATOMIC_RELAXED);
+
 		if (shutdown || allstopped)
 			break;
-		if (!verbose && !quiet)
-			printf("\033[%dA", num_threads + 2);
-
-		if (refresh_on_max) {
-			pthread_mutex_lock(&refresh_on_max_lock);
-			pthread_cond_wait(&refresh_on_max_cond,
-					  &refresh_on_max_lock);
-			pthread_mutex_unlock(&refresh_on_max_lock);
-		}
+		wait_refresh();
 	}
 	ret = EXIT_SUCCESS;
 
@@ -2128,6 +5353,18 @@ int main(int argc, char **argv)
 	shutdown = 1;
 	usleep(50000);
 
+	if (statsock_started)
+		pthread_join(statsock_threadid, NULL);
+
+	if (nr_load)
+		load_stop(load_workers, nr_load);
+
+	if (disp_fp)
+		fclose(disp_fp);
+	free(disp_buf);
+	if (loadavg_fd >= 0)
+		close(loadavg_fd);
+
 	if (quiet)
 		quiet = 2;
 	for (i = 0; i < num_threads; i++) {
@@ -2138,45 +5375,213 @@ int main(int argc, char **argv)
 			if (quiet && !histogram)
 				print_stat(stdout, parameters[i], i, 0, 0);
 		}
-		if (statistics[i]->values)
-			threadfree(statistics[i]->values, VALBUF_SIZE*sizeof(long), parameters[i]->node);
 	}
 
-	if (histogram) {
-		print_hist(parameters, num_threads);
+	if (spike_started) {
+		/* the last snapshot covers the spikes of the last period */
+		__atomic_store_n(&spike_stop, 1, __ATOMIC_RELEASE);
+		pthread_join(spike_threadid, NULL);
+	}
+
+	if (drain_started) {
+		/* let the drain thread empty the rings a last time */
+		__atomic_store_n(&drain_stop, 1, __ATOMIC_RELEASE);
+		pthread_join(drain_threadid, NULL);
+	}
+	if (use_binlog)
+		binlog_close();
+	if (verbose || use_binlog) {
 		for (i = 0; i < num_threads; i++) {
-			threadfree(statistics[i]->hist_array, histogram*sizeof(long), parameters[i]->node);
-			threadfree(statistics[i]->outliers, histogram*sizeof(long), parameters[i]->node);
+			if (statistics[i]->ring.overruns)
+				fprintf(stderr, "# Thread %d: %lu samples lost "
+					"(ring overrun)\n", i,
+					statistics[i]->ring.overruns);
 		}
 	}
 
-	if (tracelimit) {
-		print_tids(parameters, num_threads);
-		if (break_thread_id) {
-			printf("# Break thread: %d\n", break_thread_id);
-			printf("# Break value: %llu\n", (unsigned long long)break_thread_value);
+	if (use_tsc) {
+		printf("# cycle counter: %llu Hz, read %llu ns, clock_gettime %llu ns\n",
+		       (unsigned long long)tsc_hz(&tsc_calib),
+		       (unsigned long long)tsc_read_cost,
+		       (unsigned long long)clock_read_cost);
+		for (i = 0; i < num_threads; i++) {
+			struct thread_stat *stat = statistics[i];
+
+			if (stat->tsc_syncs)
+				printf("# Thread %d: cycle counter vs clock offset "
+				       "max %lld ns avg %lld ns (%lu resyncs)\n", i,
+				       (long long)stat->tsc_offset_max,
+				       (long long)(stat->tsc_offset_sum / stat->tsc_syncs),
+				       stat->tsc_syncs);
 		}
 	}
 
+	if (aligned || secaligned) {
+		int first, last;
+		int64_t skew = start_skew(&first, &last);
+
+		printf("# Start skew: %lld ns, thread %d left the barrier first, "
+		       "thread %d last\n", (long long)skew, first, last);
+	}
+
+	for (i = 0; i < audit.nr_cpus; i++) {
+		char line[1024];
+
+		audit_format(line, sizeof(line), &audit.cpus[i]);
+		printf("# Audit %s\n", line);
+	}
+
+	for (i = 0; i < num_threads; i++) {
+		struct thread_stat *stat = statistics[i];
 
-	for (i=0; i < num_threads; i++) {
-		if (!statistics[i])
+		if (!stat->missed && policy != SCHED_DEADLINE)
 			continue;
-		threadfree(statistics[i], sizeof(struct thread_stat), parameters[i]->node);
+		printf("# Thread %d missed periods: %lu in %lu of %lu cycles",
+		       i, stat->missed, stat->missed_cycles, stat->cycles);
+		for (j = 0; j < MISSED_BUCKETS; j++)
+			if (stat->missed_hist[j])
+				printf(" %d%s:%lu", j + 1,
+				       j == MISSED_BUCKETS - 1 ? "+" : "",
+				       stat->missed_hist[j]);
+		printf("\n");
 	}
 
- outpar:
+	if (numamat_lines)
+		print_numamat();
+
+	/* where the thread data is, always with --numa, else if it is remote */
 	for (i = 0; i < num_threads; i++) {
-		if (!parameters[i])
+		struct mem_block b[MEM_BLOCKS];
+		int remote, n = mem_blocks(i, b, &remote);
+
+		if (!numa && !remote)
+			continue;
+		printf("# Thread %d memory node %d:", i, parameters[i]->mem_node);
+		for (j = 0; j < n; j++)
+			printf(" %s %d%s", b[j].name, b[j].node,
+			       remote && b[j].node != parameters[i]->mem_node ? "!" : "");
+		printf("\n");
+	}
+
+	if (use_perf) {
+		for (i = 0; i < num_threads; i++) {
+			struct thread_stat *stat = statistics[i];
+
+			printf("# Thread %d perf: %s mode, counts per sample "
+			       "since the last wakeup\n", i,
+			       stat->perf_kernel ? "user and kernel" : "user");
+			print_perf(i, stat);
+		}
+	}
+
+	for (i = 0; i < num_threads && spike_period; i++) {
+		struct thread_stat *stat = statistics[i];
+		unsigned long k;
+
+		k = stat->nr_spikes > SPIKES ? stat->nr_spikes - SPIKES : 0;
+		for (; k < stat->nr_spikes; k++) {
+			struct spike *sp = &stat->spikes[k % SPIKES];
+
+			printf("# Thread %d max %ld at cycle %lu%s: ", i,
+			       sp->value, sp->cycle, sp->breach ? " (break)" : "");
+			if (sp->missing & SPIKE_NO_IRQS)
+				printf("irqs n/a");
+			else
+				printf("irqs %llu", (unsigned long long)sp->irqs);
+			spike_print_top(stdout, sp->irq_top);
+			if (sp->missing & SPIKE_NO_SOFTIRQS)
+				printf(", softirqs n/a");
+			else
+				printf(", softirqs %llu",
+				       (unsigned long long)sp->softirqs);
+			spike_print_top(stdout, sp->softirq_top);
+			printf(", ctxsw %ld/%ld in %lld ms\n", sp->nvcsw,
+			       sp->nivcsw, (long long)sp->span / 1000000);
+		}
+	}
+
+	if (work_spec.kind) {
+		for (i = 0; i < num_threads; i++) {
+			struct thread_stat *stat = statistics[i];
+
+			if (!stat->cycles)
+				continue;
+			printf("# Thread %d work: Exec Min:%8ld Avg:%8.0f P99:%8llu "
+			       "P99.9:%8llu Max:%8ld\n", i, stat->exec_min,
+			       stat->exec_sum / stat->cycles,
+			       (unsigned long long)hist_percentile(&stat->exec_hist, 99.0),
+			       (unsigned long long)hist_percentile(&stat->exec_hist, 99.9),
+			       stat->exec_max);
+			printf("# Thread %d work: Resp P99:%8llu P99.9:%8llu Max:%8ld "
+			       "Misses:%8lu\n", i,
+			       (unsigned long long)hist_percentile(&stat->resp_hist, 99.0),
+			       (unsigned long long)hist_percentile(&stat->resp_hist, 99.9),
+			       stat->resp_max, stat->misses);
+		}
+	}
+
+	for (i = 0; i < nr_load; i++) {
+		struct load_worker *w = &load_workers[i];
+
+		if (w->failed) {
+			printf("# Load %d: %s cpu %d duty %d%% size %zu: failed: %s\n",
+			       i, load_names[w->kind], w->cpu, w->duty, w->size,
+			       strerror(w->failed));
 			continue;
-		threadfree(parameters[i], sizeof(struct thread_param), parameters[i]->node);
+		}
+		printf("# Load %d: %s cpu %d duty %d%% size %zu: %llu %s (%.0f/s)\n",
+		       i, load_names[w->kind], w->cpu, w->duty, w->size,
+		       (unsigned long long)w->ops, load_units[w->kind],
+		       w->runtime ? w->ops * (double)NSEC_PER_SEC / w->runtime : 0.0);
+	}
+
+	if (deadline_count) {
+		for (i = 0; i < num_threads; i++) {
+			for (j = 0; j < deadline_count; j++) {
+				struct deadline *dl = &statistics[i]->deadlines[j];
+
+				printf("# Thread %d deadline %d: I:%lld C:%9lu Min:%8ld "
+				       "Avg:%8.0f Max:%8ld\n", i, j,
+				       (long long)dl->period / 1000, dl->cycles,
+				       dl->min, dl->cycles ? dl->sum / dl->cycles : 0.0,
+				       dl->max);
+			}
+		}
 	}
+
+	if (jsonpath[0])
+		write_json(parameters, num_threads);
+
+	if (histogram)
+		print_hist(parameters, num_threads);
+
+	if (shm_hdr) {
+		__atomic_store_n(&shm_hdr->state, TELEMETRY_FINISHED, __ATOMIC_RELEASE);
+		telemetry_close();
+	}
+
+	if (nr_windows && windowpath[0])
+		export_windows(parameters, num_threads);
+
+	if (tracelimit) {
+		print_tids(parameters, num_threads);
+		if (break_thread_id) {
+			printf("# Break thread: %d\n", break_thread_id);
+			printf("# Break value: %llu\n", (unsigned long long)break_thread_value);
+			for (i = 0; i < num_threads && flight_size; i++)
+				flight_dump(stderr, i);
+		}
+	}
+
  out:
 	/* ensure that the tracer is stopped */
 	if (tracelimit && !notrace)
 		tracing(0);
 
 
+	if (tracestop_armed)
+		kernvar(O_WRONLY, "events/ftrace/print/trigger", "!traceoff", 9);
+
 	/* close any tracer file descriptors */
 	if (tracemark_fd >= 0)
 		close(tracemark_fd);
@@ -2200,6 +5605,7 @@ int main(int argc, char **argv)
 	/* Be a nice program, cleanup */
 	if (kernelversion < KV_26_33)
 		restorekernvars();
+	kernvar_close();
 
 	/* close the latency_target_fd if it's open */
 	if (latency_target_fd >= 0)
@@ -2207,6 +5613,16 @@ int main(int argc, char **argv)
 
 	if (affinity_mask)
 		rt_bitmask_free(affinity_mask);
+	if (load_mask)
+		rt_bitmask_free(load_mask);
+	free(load_workers);
+	audit_free(&audit);
+	if (numamat_sets)
+		numamat_free(numamat_sets, numamat_nodes);
+	free(numamat_sets);
+	free(numamat_walk);
+	/* the per thread blocks from threadalloc() go with the arena */
+	arena_release();
 
 	exit(ret);
 }
@@ -0,0 +1,108 @@
+/*
+ * Log-linear latency histogram for cyclictest
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ */
+#include <string.h>
+#include <math.h>
+#include "histogram.h"
+
+/*
+ * Set up h to track values in [0, limit) with the given number of
+ * significant decimal digits. Returns the size of the counts array the
+ * caller has to allocate (and zero) into h->counts.
+ */
+size_t hist_init(struct histogram *h, uint64_t limit, int digits)
+{
+	uint64_t sub_count = 2;
+	int i;
+
+	if (digits < HIST_DIGITS_MIN)
+		digits = HIST_DIGITS_MIN;
+	if (digits > HIST_DIGITS_MAX)
+		digits = HIST_DIGITS_MAX;
+	for (i = 0; i < digits; i++)
+		sub_count *= 10;
+
+	memset(h, 0, sizeof(*h));
+	h->sub_bits = 1;
+	while ((1ULL << h->sub_bits) < sub_count)
+		h->sub_bits++;
+	h->limit = limit ? limit : 1;
+	h->nbuckets = hist_index(h, h->limit - 1) + 1;
+
+	return h->nbuckets * sizeof(*h->counts);
+}
+
+uint64_t hist_bucket_low(const struct histogram *h, unsigned int idx)
+{
+	unsigned int half = 1U << (h->sub_bits - 1);
+	unsigned int shift;
+
+	if (idx < (1U << h->sub_bits))
+		return idx;
+	idx -= 1U << h->sub_bits;
+	shift = idx / half + 1;
+	return (uint64_t)(idx % half + half) << shift;
+}
+
+uint64_t hist_bucket_high(const struct histogram *h, unsigned int idx)
+{
+	unsigned int half = 1U << (h->sub_bits - 1);
+
+	if (idx < (1U << h->sub_bits))
+		return idx;
+	return hist_bucket_low(h, idx) +
+		(1ULL << ((idx - (1U << h->sub_bits)) / half + 1)) - 1;
+}
+
+/* Number of recorded values, including the overflows */
+uint64_t hist_total(const struct histogram *h)
+{
+	uint64_t total = h->overflow;
+	unsigned int i;
+
+	for (i = 0; i < h->nbuckets; i++)
+		total += h->counts[i];
+	return total;
+}
+
+/*
+ * Smallest value v such that percentile percent of all recorded values
+ * are <= v, rounded up to the end of its bucket. Values past the
+ * tracked range report the largest overflow seen.
+ */
+uint64_t hist_percentile(const struct histogram *h, double percentile)
+{
+	uint64_t total = hist_total(h);
+	uint64_t rank, count = 0;
+	unsigned int i;
+
+	if (!total)
+		return 0;
+	rank = (uint64_t)ceil(percentile / 100.0 * total);
+	if (rank < 1)
+		rank = 1;
+
+	for (i = 0; i < h->nbuckets; i++) {
+		count += h->counts[i];
+		if (count >= rank)
+			return hist_bucket_high(h, i);
+	}
+	return h->overflow_max;
+}
+
+/* Add src to dst, both must have been set up with the same parameters */
+void hist_merge(struct histogram *dst, const struct histogram *src)
+{
+	unsigned int i;
+
+	for (i = 0; i < dst->nbuckets && i < src->nbuckets; i++)
+		dst->counts[i] += src->counts[i];
+	dst->overflow += src->overflow;
+	dst->early += src->early;
+	if (src->overflow_max > dst->overflow_max)
+		dst->overflow_max = src->overflow_max;
+}
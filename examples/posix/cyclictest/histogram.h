@@ -0,0 +1,67 @@
+/*
+ * histogram.h - log-linear latency histogram
+ *
+ * Values below 2^sub_bits are counted exactly. Above that every power
+ * of two is split into 2^(sub_bits-1) equally sized buckets, so the
+ * relative error of a bucket stays below 10^-digits while the number
+ * of buckets only grows with the logarithm of the tracked range.
+ */
+
+#ifndef __HISTOGRAM_H
+#define __HISTOGRAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HIST_DIGITS_MIN		1
+#define HIST_DIGITS_MAX		5
+
+struct histogram {
+	unsigned int sub_bits;
+	unsigned int nbuckets;
+	uint64_t limit;		/* values >= limit are overflows */
+	uint64_t overflow;
+	uint64_t overflow_max;
+	uint64_t early;		/* negative values, counted in bucket 0 */
+	uint64_t *counts;
+};
+
+size_t hist_init(struct histogram *h, uint64_t limit, int digits);
+uint64_t hist_bucket_low(const struct histogram *h, unsigned int idx);
+uint64_t hist_bucket_high(const struct histogram *h, unsigned int idx);
+uint64_t hist_total(const struct histogram *h);
+uint64_t hist_percentile(const struct histogram *h, double percentile);
+void hist_merge(struct histogram *dst, const struct histogram *src);
+
+static inline unsigned int hist_index(const struct histogram *h, uint64_t v)
+{
+	unsigned int shift;
+
+	if (v < (1ULL << h->sub_bits))
+		return v;
+	shift = 64 - __builtin_clzll(v) - h->sub_bits;
+	return (1U << h->sub_bits) + ((shift - 1) << (h->sub_bits - 1)) +
+		((v >> shift) - (1U << (h->sub_bits - 1)));
+}
+
+/*
+ * Count one value, returns 1 if it was beyond the tracked range.
+ * Early wakeups give negative values, they go to bucket 0.
+ */
+static inline int hist_record(struct histogram *h, int64_t v)
+{
+	if (v < 0) {
+		h->early++;
+		v = 0;
+	}
+	if ((uint64_t)v >= h->limit) {
+		h->overflow++;
+		if ((uint64_t)v > h->overflow_max)
+			h->overflow_max = v;
+		return 1;
+	}
+	h->counts[hist_index(h, v)]++;
+	return 0;
+}
+
+#endif	/* __HISTOGRAM_H */
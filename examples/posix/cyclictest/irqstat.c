@@ -0,0 +1,141 @@
+/*
+ * Interrupt and softirq counter snapshots for cyclictest --spikes
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "irqstat.h"
+
+static int irqstat_grow(struct irqstat *s, int rows, int cols)
+{
+	void *p;
+
+	if (cols != s->ncols || rows > s->size) {
+		if (rows < s->size)
+			rows = s->size;
+		p = realloc(s->counts, (size_t)rows * cols * sizeof(*s->counts));
+		if (!p)
+			return -1;
+		s->counts = p;
+		p = realloc(s->names, rows * sizeof(*s->names));
+		if (!p)
+			return -1;
+		s->names = p;
+		s->size = rows;
+	}
+	if (cols != s->ncols) {
+		p = realloc(s->cpus, cols * sizeof(*s->cpus));
+		if (!p)
+			return -1;
+		s->cpus = p;
+		s->ncols = cols;
+	}
+	return 0;
+}
+
+/* Read path into s, the buffers are reused from the last reading */
+int irqstat_read(struct irqstat *s, const char *path)
+{
+	char *line = NULL, *p, *end;
+	size_t len = 0;
+	int ncols = 0, col;
+	uint64_t *row;
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	if (!fp)
+		return -1;
+
+	/* the header names the cpu of each column */
+	if (getline(&line, &len, fp) < 0)
+		goto fail;
+	for (p = line; (p = strstr(p, "CPU")); p += 3)
+		ncols++;
+	if (!ncols || irqstat_grow(s, s->size ? s->size : 64, ncols))
+		goto fail;
+	for (p = line, col = 0; (p = strstr(p, "CPU")); p += 3)
+		s->cpus[col++] = atoi(p + 3);
+
+	s->nrows = 0;
+	while (getline(&line, &len, fp) >= 0) {
+		p = strchr(line, ':');
+		if (!p)
+			continue;
+		*p++ = '\0';
+		if (s->nrows == s->size &&
+		    irqstat_grow(s, 2 * s->size, ncols))
+			goto fail;
+
+		for (end = line; isspace((unsigned char)*end); end++)
+			;
+		snprintf(s->names[s->nrows], IRQSTAT_NAMELEN, "%.*s",
+			 IRQSTAT_NAMELEN - 1, end);
+		row = &s->counts[(size_t)s->nrows * ncols];
+		for (col = 0; col < ncols; col++) {
+			row[col] = strtoull(p, &end, 10);
+			if (end == p)
+				break;
+			p = end;
+		}
+		/* ERR and MIS only have a total */
+		for (; col < ncols; col++)
+			row[col] = 0;
+		s->nrows++;
+	}
+
+	free(line);
+	fclose(fp);
+	return 0;
+
+fail:
+	free(line);
+	fclose(fp);
+	return -1;
+}
+
+static uint64_t irqstat_count(const struct irqstat *s, int row, int cpu)
+{
+	const uint64_t *counts = &s->counts[(size_t)row * s->ncols];
+	uint64_t sum = 0;
+	int col;
+
+	for (col = 0; col < s->ncols; col++)
+		if (cpu < 0 || s->cpus[col] == cpu)
+			sum += counts[col];
+	return sum;
+}
+
+/*
+ * How often the source in row of now fired on cpu, or on all cpus if
+ * cpu is negative, since then. Sources that came up in between count
+ * from zero.
+ */
+uint64_t irqstat_delta(const struct irqstat *now, const struct irqstat *then,
+		       int row, int cpu)
+{
+	uint64_t c = irqstat_count(now, row, cpu), t = 0;
+	int r;
+
+	if (row < then->nrows && !strcmp(now->names[row], then->names[row]))
+		t = irqstat_count(then, row, cpu);
+	else
+		for (r = 0; r < then->nrows; r++)
+			if (!strcmp(now->names[row], then->names[r])) {
+				t = irqstat_count(then, r, cpu);
+				break;
+			}
+	return c > t ? c - t : 0;
+}
+
+void irqstat_free(struct irqstat *s)
+{
+	free(s->cpus);
+	free(s->names);
+	free(s->counts);
+	memset(s, 0, sizeof(*s));
+}
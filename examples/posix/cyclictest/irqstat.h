@@ -0,0 +1,30 @@
+/*
+ * irqstat.h - snapshots of the per cpu interrupt and softirq counters
+ *
+ * An irqstat holds one reading of /proc/interrupts or /proc/softirqs,
+ * one row per interrupt source and one column per cpu. Two readings of
+ * the same file give what fired in between.
+ */
+
+#ifndef __IRQSTAT_H
+#define __IRQSTAT_H
+
+#include <stdint.h>
+
+#define IRQSTAT_NAMELEN		16
+
+struct irqstat {
+	int nrows;
+	int ncols;
+	int size;		/* rows allocated */
+	int *cpus;		/* cpu of each column */
+	char (*names)[IRQSTAT_NAMELEN];
+	uint64_t *counts;	/* nrows x ncols */
+};
+
+int irqstat_read(struct irqstat *s, const char *path);
+uint64_t irqstat_delta(const struct irqstat *now, const struct irqstat *then,
+		       int row, int cpu);
+void irqstat_free(struct irqstat *s);
+
+#endif	/* __IRQSTAT_H */
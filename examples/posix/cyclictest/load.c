@@ -0,0 +1,409 @@
+/*
+ * Synthetic load workers for cyclictest --load
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include "error.h"
+#include "load.h"
+
+#define NSEC_PER_SEC		1000000000LL
+
+/* default working sets */
+#define MEMBW_SIZE		(64 << 20)
+#define CACHE_SIZE		(16 << 20)
+#define FORK_SIZE		(1 << 20)
+#define NET_SIZE		1400
+
+/* bytes copied by LOAD_MEMBW between two looks at the clock */
+#define MEMBW_CHUNK		(256 << 10)
+/* work items of the other kinds between two looks at the clock */
+#define LOAD_BATCH		64
+
+const char *load_names[LOAD_KINDS] = {
+	[LOAD_MEMBW]	= "membw",
+	[LOAD_CACHE]	= "cache",
+	[LOAD_SYSCALL]	= "syscall",
+	[LOAD_FORK]	= "fork",
+	[LOAD_NET]	= "net",
+};
+
+const char *load_units[LOAD_KINDS] = {
+	[LOAD_MEMBW]	= "bytes",
+	[LOAD_CACHE]	= "lines",
+	[LOAD_SYSCALL]	= "calls",
+	[LOAD_FORK]	= "forks",
+	[LOAD_NET]	= "datagrams",
+};
+
+static const size_t load_sizes[LOAD_KINDS] = {
+	[LOAD_MEMBW]	= MEMBW_SIZE,
+	[LOAD_CACHE]	= CACHE_SIZE,
+	[LOAD_SYSCALL]	= 0,
+	[LOAD_FORK]	= FORK_SIZE,
+	[LOAD_NET]	= NET_SIZE,
+};
+
+static int load_shutdown;
+
+/* What a helper process reports back, in a shared mapping */
+struct load_shared {
+	uint64_t ops;
+	int64_t runtime;
+	int failed;
+	int stop;
+};
+
+static inline int64_t load_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+int load_kind(const char *name)
+{
+	int i;
+
+	for (i = 0; i < LOAD_KINDS; i++)
+		if (!strcmp(name, load_names[i]))
+			return i;
+	return -1;
+}
+
+void load_init(struct load_worker *w, int kind, int cpu, int duty)
+{
+	memset(w, 0, sizeof(*w));
+	w->kind = kind;
+	w->cpu = cpu;
+	w->duty = duty;
+	w->size = load_sizes[kind];
+	w->start_fd = -1;
+}
+
+/* State of one worker between two work batches */
+struct load_state {
+	char *buf;
+	char *buf2;
+	unsigned int pass;
+	uint64_t seed;
+	int sock;
+	struct sockaddr_in addr;
+};
+
+static int load_setup(struct load_worker *w, struct load_state *st)
+{
+	socklen_t len = sizeof(st->addr);
+
+	memset(st, 0, sizeof(*st));
+	st->seed = 88172645463325252ULL ^ (uintptr_t)w;
+	st->sock = -1;
+
+	switch (w->kind) {
+	case LOAD_MEMBW:
+		st->buf2 = malloc(w->size);
+		if (!st->buf2)
+			return -1;
+		memset(st->buf2, 1, w->size);
+		/* fall through */
+	case LOAD_CACHE:
+	case LOAD_NET:
+		st->buf = malloc(w->size);
+		if (!st->buf)
+			return -1;
+		memset(st->buf, 0, w->size);
+		break;
+	}
+
+	if (w->kind == LOAD_NET) {
+		/* a socket bound to loopback sends to itself */
+		st->sock = socket(AF_INET, SOCK_DGRAM|SOCK_NONBLOCK, 0);
+		if (st->sock < 0)
+			return -1;
+		st->addr.sin_family = AF_INET;
+		st->addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		if (bind(st->sock, (struct sockaddr *)&st->addr, sizeof(st->addr)) ||
+		    getsockname(st->sock, (struct sockaddr *)&st->addr, &len))
+			return -1;
+	}
+	return 0;
+}
+
+static void load_cleanup(struct load_state *st)
+{
+	free(st->buf);
+	free(st->buf2);
+	if (st->sock >= 0)
+		close(st->sock);
+}
+
+/* One batch of work, returns the work items done */
+static uint64_t load_batch(struct load_worker *w, struct load_state *st)
+{
+	uint64_t ops = 0;
+	size_t lines, off;
+	void *map;
+	pid_t pid;
+	int i;
+
+	switch (w->kind) {
+	case LOAD_MEMBW:
+		/* alternate direction so both buffers stay hot in turn */
+		st->pass++;
+		for (off = 0; off + MEMBW_CHUNK <= w->size; off += MEMBW_CHUNK) {
+			if (st->pass & 1)
+				memcpy(st->buf + off, st->buf2 + off, MEMBW_CHUNK);
+			else
+				memcpy(st->buf2 + off, st->buf + off, MEMBW_CHUNK);
+			if ((off / MEMBW_CHUNK) % 16 == 15 &&
+			    __atomic_load_n(&load_shutdown, __ATOMIC_RELAXED))
+				break;
+		}
+		return off;
+
+	case LOAD_CACHE:
+		lines = w->size / 64;
+		for (i = 0; i < LOAD_BATCH * 64; i++) {
+			/* xorshift64 picks the next line */
+			st->seed ^= st->seed << 13;
+			st->seed ^= st->seed >> 7;
+			st->seed ^= st->seed << 17;
+			st->buf[(st->seed % lines) * 64]++;
+		}
+		return i;
+
+	case LOAD_SYSCALL:
+		for (i = 0; i < LOAD_BATCH; i++)
+			syscall(SYS_getppid);
+		return i;
+
+	case LOAD_FORK:
+		for (i = 0; i < LOAD_BATCH / 16; i++) {
+			map = mmap(NULL, w->size, PROT_READ|PROT_WRITE,
+				   MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+			if (map != MAP_FAILED) {
+				memset(map, 0, w->size);
+				munmap(map, w->size);
+			}
+			pid = fork();
+			if (pid == 0)
+				_exit(0);
+			if (pid > 0) {
+				waitpid(pid, NULL, 0);
+				ops++;
+			}
+		}
+		return ops;
+
+	case LOAD_NET:
+		for (i = 0; i < LOAD_BATCH; i++) {
+			if (sendto(st->sock, st->buf, w->size, 0,
+				   (struct sockaddr *)&st->addr,
+				   sizeof(st->addr)) > 0)
+				ops++;
+			while (recv(st->sock, st->buf, w->size, 0) > 0)
+				;
+		}
+		return ops;
+	}
+	return 0;
+}
+
+/* Run the duty cycle until *stop is set, returns the runtime in ns */
+static int64_t load_run(struct load_worker *w, struct load_state *st,
+			int *stop, uint64_t *ops)
+{
+	int64_t start, period, busy, now;
+	struct timespec ts;
+
+	busy = LOAD_PERIOD * w->duty / 100;
+	start = period = load_now();
+	while (!__atomic_load_n(stop, __ATOMIC_RELAXED)) {
+		__atomic_store_n(ops, *ops + load_batch(w, st), __ATOMIC_RELAXED);
+		if (w->duty >= 100)
+			continue;
+		now = load_now();
+		if (now - period < busy)
+			continue;
+		/* sleep for the rest of the period */
+		period += LOAD_PERIOD;
+		if (period > now) {
+			ts.tv_sec = period / NSEC_PER_SEC;
+			ts.tv_nsec = period % NSEC_PER_SEC;
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+		} else
+			period = now;
+	}
+	return load_now() - start;
+}
+
+static void load_pin(struct load_worker *w)
+{
+	cpu_set_t mask;
+
+	if (w->cpu < 0)
+		return;
+	CPU_ZERO(&mask);
+	CPU_SET(w->cpu, &mask);
+	pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask);
+}
+
+static void *load_thread(void *arg)
+{
+	struct load_worker *w = arg;
+	struct load_state st;
+
+	load_pin(w);
+	if (load_setup(w, &st)) {
+		w->failed = errno ? errno : ENOMEM;
+		warn("load worker %s failed to start: %s\n",
+		     load_names[w->kind], strerror(w->failed));
+		load_cleanup(&st);
+		return NULL;
+	}
+	w->runtime = load_run(w, &st, &load_shutdown, &w->ops);
+
+	load_cleanup(&st);
+	return NULL;
+}
+
+/* Body of a helper process, never returns */
+static void load_helper(struct load_worker *w, int fd, pid_t parent)
+{
+	struct sched_param param = { .sched_priority = 0 };
+	struct load_shared *sh = w->shared;
+	struct load_state st;
+	char c;
+
+	/* go with cyclictest, whichever way it ends */
+	prctl(PR_SET_PDEATHSIG, SIGKILL);
+	if (getppid() != parent)
+		_exit(0);
+	sched_setscheduler(0, SCHED_OTHER, &param);
+	load_pin(w);
+
+	/* nothing to do if cyclictest gives up before the test starts */
+	if (read(fd, &c, 1) != 1)
+		_exit(0);
+	close(fd);
+
+	if (load_setup(w, &st)) {
+		sh->failed = errno ? errno : ENOMEM;
+		_exit(1);
+	}
+	sh->runtime = load_run(w, &st, &sh->stop, &sh->ops);
+	_exit(0);
+}
+
+/*
+ * Fork the helper process of a worker that has to fork itself. Called
+ * early, the helper shares what cyclictest has mapped so far; its own
+ * forks then leave the memory of the measurement threads alone.
+ */
+int load_spawn(struct load_worker *w)
+{
+	pid_t parent = getpid();
+	int fds[2];
+
+	w->shared = mmap(NULL, sizeof(*w->shared), PROT_READ|PROT_WRITE,
+			 MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if (w->shared == MAP_FAILED) {
+		w->shared = NULL;
+		return -1;
+	}
+	if (pipe2(fds, O_CLOEXEC)) {
+		munmap(w->shared, sizeof(*w->shared));
+		w->shared = NULL;
+		return -1;
+	}
+	w->pid = fork();
+	if (w->pid == 0) {
+		close(fds[1]);
+		load_helper(w, fds[0], parent);
+	}
+	close(fds[0]);
+	if (w->pid < 0) {
+		close(fds[1]);
+		munmap(w->shared, sizeof(*w->shared));
+		w->shared = NULL;
+		w->pid = 0;
+		return -1;
+	}
+	w->start_fd = fds[1];
+	return 0;
+}
+
+int load_start(struct load_worker *w)
+{
+	int ret;
+
+	if (w->pid) {
+		ret = write(w->start_fd, "", 1);
+		close(w->start_fd);
+		w->start_fd = -1;
+		if (ret != 1)
+			return -1;
+		w->started = 1;
+		return 0;
+	}
+
+	__atomic_store_n(&load_shutdown, 0, __ATOMIC_RELAXED);
+	ret = pthread_create(&w->thread, NULL, load_thread, w);
+	if (ret) {
+		errno = ret;
+		return -1;
+	}
+	w->started = 1;
+	return 0;
+}
+
+void load_stop(struct load_worker *w, int count)
+{
+	int i;
+
+	__atomic_store_n(&load_shutdown, 1, __ATOMIC_RELAXED);
+	for (i = 0; i < count; i++)
+		if (w[i].shared)
+			__atomic_store_n(&w[i].shared->stop, 1, __ATOMIC_RELAXED);
+
+	for (i = 0; i < count; i++) {
+		if (w[i].pid) {
+			/* a helper never started sees its pipe close */
+			if (w[i].start_fd >= 0)
+				close(w[i].start_fd);
+			waitpid(w[i].pid, NULL, 0);
+			w[i].ops = w[i].shared->ops;
+			w[i].runtime = w[i].shared->runtime;
+			w[i].failed = w[i].shared->failed;
+			if (w[i].failed)
+				warn("load worker %s failed to start: %s\n",
+				     load_names[w[i].kind], strerror(w[i].failed));
+			munmap(w[i].shared, sizeof(*w[i].shared));
+			w[i].shared = NULL;
+			w[i].pid = 0;
+			w[i].started = 0;
+			continue;
+		}
+		if (!w[i].started)
+			continue;
+		pthread_join(w[i].thread, NULL);
+		w[i].started = 0;
+	}
+}
@@ -0,0 +1,61 @@
+/*
+ * load.h - synthetic load workers run next to the measurement threads
+ *
+ * Every worker runs one kind of load on its own SCHED_OTHER thread,
+ * optionally pinned to a cpu. It works for duty percent of each
+ * LOAD_PERIOD and sleeps for the rest, and counts the work items it
+ * got done so that the load can be reported along with the latencies.
+ *
+ * LOAD_FORK workers run in a helper process instead, forked once by
+ * load_spawn() before cyclictest locks and allocates its memory. A
+ * fork() from cyclictest itself would write protect the pages of the
+ * measurement threads, and their next writes would take faults.
+ */
+
+#ifndef __LOAD_H
+#define __LOAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+struct load_shared;
+
+/* duty cycle period in ns */
+#define LOAD_PERIOD		10000000LL
+
+enum {
+	LOAD_MEMBW,		/* memcpy() between two large buffers */
+	LOAD_CACHE,		/* random cache line writes */
+	LOAD_SYSCALL,		/* cheap system calls */
+	LOAD_FORK,		/* fork()/wait() and mmap()/munmap() */
+	LOAD_NET,		/* UDP datagrams over loopback */
+	LOAD_KINDS
+};
+
+struct load_worker {
+	int kind;
+	int cpu;		/* -1 if not pinned */
+	int duty;		/* in percent */
+	size_t size;		/* working set in bytes */
+	uint64_t ops;		/* work items done */
+	int64_t runtime;	/* ns from start to stop */
+	int failed;		/* errno of a failed setup, 0 if it ran */
+	pthread_t thread;
+	int started;
+	pid_t pid;		/* helper process, 0 if a thread */
+	int start_fd;		/* written to by load_start() for the helper */
+	struct load_shared *shared;
+};
+
+extern const char *load_names[LOAD_KINDS];
+extern const char *load_units[LOAD_KINDS];
+
+int load_kind(const char *name);
+void load_init(struct load_worker *w, int kind, int cpu, int duty);
+int load_spawn(struct load_worker *w);
+int load_start(struct load_worker *w);
+void load_stop(struct load_worker *w, int count);
+
+#endif	/* __LOAD_H */
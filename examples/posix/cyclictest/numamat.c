@@ -0,0 +1,89 @@
+/*
+ * Memory latency per cpu node and memory node for cyclictest --numa-matrix
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ */
+#include <stdlib.h>
+#include <errno.h>
+#include "arena.h"
+#include "numamat.h"
+
+/*
+ * Link the lines of the set into one random cycle: line perm[i] points
+ * to line perm[i + 1]. The same seed gives every node the same chain.
+ */
+static void numamat_link(struct numamat_set *set, size_t *perm, int threads)
+{
+	char *base = set->base;
+	uint64_t x = 0x9e3779b97f4a7c15ULL;
+	size_t i, j, t;
+
+	for (i = 0; i < set->lines; i++)
+		perm[i] = i;
+	for (i = set->lines - 1; i > 0; i--) {
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		j = x % (i + 1);
+		t = perm[i];
+		perm[i] = perm[j];
+		perm[j] = t;
+	}
+	for (i = 0; i < set->lines; i++)
+		*(void **)(base + perm[i] * NUMAMAT_LINE) =
+			base + perm[(i + 1) % set->lines] * NUMAMAT_LINE;
+	for (i = 0; i < (size_t)threads; i++)
+		set->start[i] = base + perm[i * set->lines / threads] * NUMAMAT_LINE;
+}
+
+/*
+ * Place a set of bytes on each of the online nodes, the sets of the
+ * others are left empty. Returns -1 with errno set if the memory is
+ * not there.
+ */
+int numamat_init(struct numamat_set *sets, int nodes, size_t bytes,
+		 int threads)
+{
+	size_t *perm;
+	int n;
+
+	/* every thread starts on a line of its own */
+	if (bytes < 2 * NUMAMAT_LINE || bytes / NUMAMAT_LINE < (size_t)threads) {
+		errno = EINVAL;
+		return -1;
+	}
+	perm = malloc(bytes / NUMAMAT_LINE * sizeof(*perm));
+	if (!perm)
+		return -1;
+	for (n = 0; n < nodes; n++) {
+		struct numamat_set *set = &sets[n];
+
+		/* a hole in the node numbers, as in "0,2" */
+		if (!arena_node_online(n)) {
+			set->placed = -1;
+			continue;
+		}
+		set->lines = bytes / NUMAMAT_LINE;
+		set->base = arena_alloc(set->lines * NUMAMAT_LINE, n);
+		set->start = calloc(threads, sizeof(*set->start));
+		if (!set->base || !set->start) {
+			free(perm);
+			return -1;
+		}
+		numamat_link(set, perm, threads);
+		set->placed = arena_node_of(set->base);
+	}
+	free(perm);
+	return 0;
+}
+
+void numamat_free(struct numamat_set *sets, int nodes)
+{
+	int n;
+
+	/* the sets themselves go with the arena */
+	for (n = 0; n < nodes; n++)
+		free(sets[n].start);
+}
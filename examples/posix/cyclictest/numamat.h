@@ -0,0 +1,62 @@
+/*
+ * numamat.h - memory latency per cpu node and memory node for
+ * cyclictest --numa-matrix
+ *
+ * Every memory node gets a working set, one cache line per element,
+ * linked into a single random cycle so that each load depends on the
+ * one before and neither the prefetchers nor out of order execution
+ * can hide the latency. Each cycle a measurement thread follows a
+ * stretch of the chain in the set of one node, going round the nodes,
+ * and accounts the time under the node of its cpu and the node of the
+ * set. The sets are larger than the caches, a stretch is only visited
+ * again after the whole chain has been walked.
+ */
+
+#ifndef __NUMAMAT_H
+#define __NUMAMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define NUMAMAT_LINE		64
+
+struct numamat_set {
+	void *base;		/* NULL if the node is not online */
+	size_t lines;
+	int placed;		/* node the set ended up on, -1 if unknown */
+	void **start;		/* where each thread starts, spread over the chain */
+};
+
+/* One (cpu node, memory node) pair */
+struct numamat_cell {
+	unsigned long cycles;
+	int64_t touch_sum;	/* ns to follow the stretch */
+	int64_t touch_max;
+	int64_t resp_sum;	/* ns from the expected wakeup to the end */
+	int64_t resp_max;
+};
+
+int numamat_init(struct numamat_set *sets, int nodes, size_t bytes,
+		 int threads);
+void numamat_free(struct numamat_set *sets, int nodes);
+
+static inline void *numamat_touch(void *p, unsigned long lines)
+{
+	while (lines--)
+		p = *(void * volatile *)p;
+	return p;
+}
+
+static inline void numamat_account(struct numamat_cell *c, int64_t touch,
+				   int64_t resp)
+{
+	c->cycles++;
+	c->touch_sum += touch;
+	if (touch > c->touch_max)
+		c->touch_max = touch;
+	c->resp_sum += resp;
+	if (resp > c->resp_max)
+		c->resp_max = resp;
+}
+
+#endif	/* __NUMAMAT_H */
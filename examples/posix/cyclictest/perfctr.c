@@ -0,0 +1,114 @@
+/*
+ * Hardware counters for cyclictest --perf
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ */
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "perfctr.h"
+
+const char *perf_names[PERF_EVENTS] = {
+	[PERF_CYCLES]		= "cycles",
+	[PERF_INSTRUCTIONS]	= "instructions",
+	[PERF_CACHE_MISSES]	= "cache-misses",
+	[PERF_DTLB_MISSES]	= "dTLB-misses",
+	[PERF_BRANCH_MISSES]	= "branch-misses",
+};
+
+static const struct {
+	uint32_t type;
+	uint64_t config;
+} perf_events[PERF_EVENTS] = {
+	[PERF_CYCLES]		= { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	[PERF_INSTRUCTIONS]	= { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	[PERF_CACHE_MISSES]	= { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+	[PERF_DTLB_MISSES]	= { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+				    (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+				    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+	[PERF_BRANCH_MISSES]	= { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+};
+
+static int perf_event_open(struct perf_event_attr *attr)
+{
+	return syscall(SYS_perf_event_open, attr, 0, -1, -1, 0);
+}
+
+uint64_t perf_read_fd(struct perf_counter *c)
+{
+	uint64_t v;
+
+	if (read(c->fd, &v, sizeof(v)) != sizeof(v))
+		return c->last;
+	return v;
+}
+
+/*
+ * Open the counters on the calling thread. Kernel mode is counted as
+ * well unless perf_event_paranoid forbids it. Events the cpu does not
+ * have are left out, fails with errno set if none could be opened.
+ */
+int perf_open(struct perf_set *p)
+{
+	struct perf_event_attr attr;
+	int i, err = ENOENT;
+
+	memset(p, 0, sizeof(*p));
+	for (i = 0; i < PERF_EVENTS; i++)
+		p->ctr[i].fd = -1;
+	p->kernel = 1;
+	for (i = 0; i < PERF_EVENTS; i++) {
+		struct perf_counter *c = &p->ctr[i];
+
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = perf_events[i].type;
+		attr.config = perf_events[i].config;
+		attr.exclude_hv = 1;
+		attr.exclude_kernel = !p->kernel;
+		c->fd = perf_event_open(&attr);
+		if (c->fd < 0 && (errno == EACCES || errno == EPERM) && p->kernel) {
+			/* restart in user mode only, all counters alike */
+			perf_close(p);
+			p->kernel = 0;
+			i = -1;
+			continue;
+		}
+		if (c->fd < 0) {
+			err = errno;
+			continue;
+		}
+		c->page = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ,
+			       MAP_SHARED, c->fd, 0);
+		if (c->page == MAP_FAILED)
+			c->page = NULL;
+		c->last = perf_value(c);
+		p->count++;
+	}
+	if (!p->count) {
+		errno = err;
+		return -1;
+	}
+	return 0;
+}
+
+void perf_close(struct perf_set *p)
+{
+	int i;
+
+	for (i = 0; i < PERF_EVENTS; i++) {
+		struct perf_counter *c = &p->ctr[i];
+
+		if (c->page)
+			munmap(c->page, sysconf(_SC_PAGESIZE));
+		if (c->fd >= 0)
+			close(c->fd);
+		c->page = NULL;
+		c->fd = -1;
+	}
+	p->count = 0;
+}
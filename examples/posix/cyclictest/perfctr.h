@@ -0,0 +1,114 @@
+/*
+ * perfctr.h - per thread hardware counters for cyclictest --perf
+ *
+ * The counters are opened with perf_event_open() on the measurement
+ * thread itself and only count while it runs. Where the kernel allows
+ * it they are read from user space with rdpmc through the mmap'ed
+ * control page, so a reading costs no system call; otherwise, and for
+ * counters that are not on the PMU at that moment, read(2) is used.
+ */
+
+#ifndef __PERFCTR_H
+#define __PERFCTR_H
+
+#include <stdint.h>
+#include <linux/perf_event.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PERF_RDPMC	1
+#else
+#define PERF_RDPMC	0
+#endif
+
+enum {
+	PERF_CYCLES,
+	PERF_INSTRUCTIONS,
+	PERF_CACHE_MISSES,
+	PERF_DTLB_MISSES,
+	PERF_BRANCH_MISSES,
+	PERF_EVENTS
+};
+
+struct perf_counter {
+	int fd;			/* -1 if the event is not available */
+	struct perf_event_mmap_page *page;
+	uint64_t last;
+};
+
+struct perf_set {
+	int count;		/* events opened */
+	int kernel;		/* kernel mode is counted too */
+	struct perf_counter ctr[PERF_EVENTS];
+};
+
+extern const char *perf_names[PERF_EVENTS];
+
+int perf_open(struct perf_set *p);
+void perf_close(struct perf_set *p);
+
+#if PERF_RDPMC
+static inline uint64_t perf_rdpmc(unsigned int idx)
+{
+	uint32_t lo, hi;
+
+	__asm__ __volatile__("rdpmc" : "=a" (lo), "=d" (hi) : "c" (idx));
+	return ((uint64_t)hi << 32) | lo;
+}
+#endif
+
+uint64_t perf_read_fd(struct perf_counter *c);
+
+/*
+ * Current value of one counter, the retry loop and the sign extension
+ * of the raw counter follow the rules of struct perf_event_mmap_page.
+ */
+static inline uint64_t perf_value(struct perf_counter *c)
+{
+#if PERF_RDPMC
+	struct perf_event_mmap_page *pc = c->page;
+	uint32_t seq, idx, width;
+	uint64_t count;
+	int64_t pmc;
+
+	if (pc && pc->cap_user_rdpmc) {
+		do {
+			seq = pc->lock;
+			__atomic_signal_fence(__ATOMIC_SEQ_CST);
+			idx = pc->index;
+			count = pc->offset;
+			if (!idx)
+				break;
+			width = pc->pmc_width;
+			pmc = perf_rdpmc(idx - 1);
+			pmc <<= 64 - width;
+			pmc >>= 64 - width;
+			count += pmc;
+			__atomic_signal_fence(__ATOMIC_SEQ_CST);
+		} while (pc->lock != seq);
+		if (idx)
+			return count;
+	}
+#endif
+	return perf_read_fd(c);
+}
+
+/* What each counter counted since the last call, 0 if not available */
+static inline void perf_read(struct perf_set *p, uint64_t *delta)
+{
+	uint64_t v;
+	int i;
+
+	for (i = 0; i < PERF_EVENTS; i++) {
+		struct perf_counter *c = &p->ctr[i];
+
+		if (c->fd < 0) {
+			delta[i] = 0;
+			continue;
+		}
+		v = perf_value(c);
+		delta[i] = v - c->last;
+		c->last = v;
+	}
+}
+
+#endif	/* __PERFCTR_H */
@@ -0,0 +1,104 @@
+/*
+ * P-square streaming quantile estimator for cyclictest
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ */
+#include <string.h>
+#include "quantile.h"
+
+void p2_init(struct p2_quantile *q, double percentile)
+{
+	double p = percentile / 100.0;
+
+	memset(q, 0, sizeof(*q));
+	q->p = p;
+	q->step[0] = 0.0;
+	q->step[1] = p / 2.0;
+	q->step[2] = p;
+	q->step[3] = (1.0 + p) / 2.0;
+	q->step[4] = 1.0;
+}
+
+static double parabolic(const struct p2_quantile *q, int i, int d)
+{
+	double n0 = q->pos[i - 1], n1 = q->pos[i], n2 = q->pos[i + 1];
+
+	return q->height[i] + d / (n2 - n0) *
+		((n1 - n0 + d) * (q->height[i + 1] - q->height[i]) / (n2 - n1) +
+		 (n2 - n1 - d) * (q->height[i] - q->height[i - 1]) / (n1 - n0));
+}
+
+static double linear(const struct p2_quantile *q, int i, int d)
+{
+	return q->height[i] + d * (q->height[i + d] - q->height[i]) /
+		(q->pos[i + d] - q->pos[i]);
+}
+
+void p2_add(struct p2_quantile *q, double x)
+{
+	int i, k;
+
+	/* collect and sort the first five observations */
+	if (q->count < 5) {
+		for (i = q->count; i > 0 && q->height[i - 1] > x; i--)
+			q->height[i] = q->height[i - 1];
+		q->height[i] = x;
+		if (++q->count == 5) {
+			for (i = 0; i < 5; i++) {
+				q->pos[i] = i + 1;
+				q->want[i] = 1.0 + 4.0 * q->step[i];
+			}
+		}
+		return;
+	}
+	q->count++;
+
+	/* find the cell k the observation falls into */
+	if (x < q->height[0]) {
+		q->height[0] = x;
+		k = 0;
+	} else if (x >= q->height[4]) {
+		q->height[4] = x;
+		k = 3;
+	} else {
+		for (k = 0; k < 3 && x >= q->height[k + 1]; k++)
+			;
+	}
+
+	for (i = k + 1; i < 5; i++)
+		q->pos[i]++;
+	for (i = 0; i < 5; i++)
+		q->want[i] += q->step[i];
+
+	/* move the middle markers towards their desired positions */
+	for (i = 1; i < 4; i++) {
+		double d = q->want[i] - q->pos[i];
+
+		if ((d >= 1.0 && q->pos[i + 1] - q->pos[i] > 1) ||
+		    (d <= -1.0 && q->pos[i - 1] - q->pos[i] < -1)) {
+			int s = d > 0 ? 1 : -1;
+			double h = parabolic(q, i, s);
+
+			if (q->height[i - 1] < h && h < q->height[i + 1])
+				q->height[i] = h;
+			else
+				q->height[i] = linear(q, i, s);
+			q->pos[i] += s;
+		}
+	}
+}
+
+double p2_value(const struct p2_quantile *q)
+{
+	int i;
+
+	if (q->count >= 5)
+		return q->height[2];
+	if (!q->count)
+		return 0.0;
+	/* too few observations for the markers, pick from the sorted ones */
+	i = (int)(q->p * (q->count - 1) + 0.5);
+	return q->height[i];
+}
@@ -0,0 +1,25 @@
+/*
+ * quantile.h - streaming quantile estimation with the P-square algorithm
+ *
+ * R. Jain and I. Chlamtac, "The P^2 algorithm for dynamic calculation of
+ * quantiles and histograms without storing observations", CACM 28(10).
+ * Five markers per quantile, constant memory and cost per observation.
+ */
+
+#ifndef __QUANTILE_H
+#define __QUANTILE_H
+
+struct p2_quantile {
+	double p;
+	unsigned long count;
+	long pos[5];		/* actual marker positions */
+	double want[5];		/* desired marker positions */
+	double step[5];		/* desired position increments */
+	double height[5];	/* marker heights */
+};
+
+void p2_init(struct p2_quantile *q, double percentile);
+void p2_add(struct p2_quantile *q, double x);
+double p2_value(const struct p2_quantile *q);
+
+#endif	/* __QUANTILE_H */
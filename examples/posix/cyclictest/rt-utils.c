@@ -317,3 +317,29 @@ pid_t gettid(void)
 {
 	return syscall(SYS_gettid);
 }
+
+#ifdef SYS_sched_setattr
+int sched_setattr(pid_t pid, const struct sched_attr *attr, unsigned int flags)
+{
+	return syscall(SYS_sched_setattr, pid, attr, flags);
+}
+
+int sched_getattr(pid_t pid, struct sched_attr *attr, unsigned int size,
+		  unsigned int flags)
+{
+	return syscall(SYS_sched_getattr, pid, attr, size, flags);
+}
+#else
+int sched_setattr(pid_t pid, const struct sched_attr *attr, unsigned int flags)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+int sched_getattr(pid_t pid, struct sched_attr *attr, unsigned int size,
+		  unsigned int flags)
+{
+	errno = ENOSYS;
+	return -1;
+}
+#endif
@@ -22,6 +22,7 @@
 
 #include "rt-utils.h"
 #include "error.h"
+#include "arena.h"
 
 static int numa = 0;
 
@@ -32,23 +33,6 @@ static int numa = 0;
 #define LIBNUMA_API_VERSION 1
 #endif
 
-static void *
-threadalloc(size_t size, int node)
-{
-	if (node == -1)
-		return malloc(size);
-	return numa_alloc_onnode(size, node);
-}
-
-static void
-threadfree(void *ptr, size_t size, int node)
-{
-	if (node == -1)
-		free(ptr);
-	else
-		numa_free(ptr, size);
-}
-
 static void rt_numa_set_numa_run_on_node(int node, int cpu)
 {
 	int res;
@@ -59,16 +43,6 @@ static void rt_numa_set_numa_run_on_node(int node, int cpu)
 	return;
 }
 
-static void *rt_numa_numa_alloc_onnode(size_t size, int node, int cpu)
-{
-	void *stack;
-	stack = numa_alloc_onnode(size, node);
-	if (stack == NULL)
-		fatal("failed to allocate %d bytes on node %d for cpu %d\n",
-				size, node, cpu);
-	return stack;
-}
-
 #if LIBNUMA_API_VERSION >= 2
 
 /*
@@ -192,6 +166,11 @@ static inline void rt_bitmask_free(struct bitmask *mask)
 
 #endif	/* LIBNUMA_API_VERSION */
 
+static inline int rt_numa_node_count(void)
+{
+	return numa_available() == -1 ? 1 : numa_max_node() + 1;
+}
+
 static void numa_on_and_available()
 {
 	if (numa && (numa_available() == -1))
@@ -206,11 +185,8 @@ struct bitmask {
 };
 #define BITS_PER_LONG    (8*sizeof(long))
 
-static inline void *threadalloc(size_t size, int n) { return malloc(size); }
-static inline void threadfree(void *ptr, size_t s, int n) { free(ptr); }
 static inline void rt_numa_set_numa_run_on_node(int n, int c) { }
 static inline int rt_numa_numa_node_of_cpu(int cpu) { return -1; }
-static void *rt_numa_numa_alloc_onnode(size_t s, int n, int c) { return NULL; }
 
 /*
  * Map legacy CPU affinity behavior onto bit mask infrastructure
@@ -257,8 +233,20 @@ static inline void rt_bitmask_free(struct bitmask *mask)
 
 static inline void numa_on_and_available(void) { }
 
+static inline int rt_numa_node_count(void) { return arena_node_count(); }
+
 #endif	/* NUMA */
 
+/*
+ * Per-thread blocks come pre-faulted from the arena of their node and
+ * are cache line aligned, so data of neighbouring threads never ends up
+ * on the same line. They are all released together by arena_release().
+ */
+static inline void *threadalloc(size_t size, int node)
+{
+	return arena_alloc(size, node);
+}
+
 /*
  * Any behavioral differences above are transparent to these functions
  */
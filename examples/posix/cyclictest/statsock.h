@@ -0,0 +1,23 @@
+/*
+ * statsock.h - the unix domain socket cyclictest -F serves its stats on
+ *
+ * Kept apart from cyclictest.c, which has a global named after
+ * shutdown(2) and so cannot see <sys/socket.h>.
+ */
+
+#ifndef __STATSOCK_H
+#define __STATSOCK_H
+
+#include <stddef.h>
+
+/* 0 if path fits a socket address, -1 with ENAMETOOLONG otherwise */
+int statsock_check(const char *path);
+
+/* Non-blocking listening socket at path, replacing what was there */
+int statsock_listen(const char *path, int backlog);
+int statsock_accept(int fd);
+
+/* Send all of buf without waiting, -1 if the client is not keeping up */
+int statsock_send(int fd, const void *buf, size_t len);
+
+#endif	/* __STATSOCK_H */
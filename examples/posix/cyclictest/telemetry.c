@@ -0,0 +1,114 @@
+/*
+ * Read-only access to the cyclictest --shm telemetry segment
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "telemetry.h"
+
+/* give up on a slot whose writer died in the middle of an update */
+#define READ_RETRIES	100000
+
+/*
+ * Map the segment name read-only and check that we understand its
+ * layout. The leading slash of name is optional, as with --shm. Returns 0 on success, -1 with errno set otherwise.
+ */
+int telemetry_attach(struct telemetry *t, const char *name)
+{
+	const struct telemetry_header *hdr;
+	char path[NAME_MAX + 2];
+	struct stat st;
+	void *map;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s%s", name[0] == '/' ? "" : "/", name);
+	fd = shm_open(path, O_RDONLY, 0);
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		return -1;
+	}
+	if ((size_t)st.st_size < sizeof(*hdr)) {
+		close(fd);
+		errno = EINVAL;
+		return -1;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -1;
+
+	hdr = map;
+	if (memcmp(hdr->magic, TELEMETRY_MAGIC, sizeof(hdr->magic)) ||
+	    hdr->version != TELEMETRY_VERSION ||
+	    hdr->slot_size < telemetry_slot_size(hdr->hist_nbuckets) ||
+	    hdr->header_size + (size_t)hdr->nthreads * hdr->slot_size >
+	    (size_t)st.st_size) {
+		munmap(map, st.st_size);
+		errno = EPROTO;
+		return -1;
+	}
+
+	t->hdr = hdr;
+	t->size = st.st_size;
+	return 0;
+}
+
+void telemetry_detach(struct telemetry *t)
+{
+	if (t->hdr)
+		munmap((void *)t->hdr, t->size);
+	t->hdr = NULL;
+}
+
+/*
+ * Consistent copy of the slot of thread into slot and, unless counts
+ * is NULL, of its hist_nbuckets histogram counts into counts. Never
+ * blocks the writer, retries while an update is in progress and fails
+ * with EBUSY if the slot does not settle.
+ */
+int telemetry_read(const struct telemetry *t, unsigned int thread,
+		   struct telemetry_slot *slot, uint64_t *counts)
+{
+	const struct telemetry_slot *src;
+	uint32_t seq;
+	int retries = READ_RETRIES;
+
+	if (thread >= t->hdr->nthreads) {
+		errno = EINVAL;
+		return -1;
+	}
+	src = telemetry_slot(t->hdr, thread);
+
+	for (;; retries--) {
+		if (!retries) {
+			errno = EBUSY;
+			return -1;
+		}
+		seq = __atomic_load_n(&src->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1) {
+			sched_yield();
+			continue;
+		}
+		memcpy(slot, src, sizeof(*slot));
+		if (counts)
+			memcpy(counts, src->counts,
+			       t->hdr->hist_nbuckets * sizeof(*counts));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&src->seq, __ATOMIC_RELAXED) == seq)
+			break;
+	}
+	slot->seq = seq;
+	return 0;
+}
@@ -0,0 +1,99 @@
+/*
+ * telemetry.h - live statistics segment exported by cyclictest --shm
+ *
+ * The POSIX shared memory object starts with a struct telemetry_header
+ * followed by one struct telemetry_slot per measurement thread, each
+ * slot_size bytes long and cache line aligned. A slot ends with the
+ * live histogram counts of its thread (hist_nbuckets entries, none if
+ * no histogram was requested). All values are in host byte order.
+ *
+ * Every slot is guarded by a sequence counter: the measuring thread
+ * makes it odd before it updates the slot and even again afterwards.
+ * Readers copy the slot and retry when the counter was odd or changed
+ * meanwhile, so they never block the writer.
+ */
+
+#ifndef __TELEMETRY_H
+#define __TELEMETRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TELEMETRY_MAGIC		"CTSM"
+#define TELEMETRY_VERSION	1
+#define TELEMETRY_QUANTILES	3
+#define TELEMETRY_ALIGN		64
+
+/* header units */
+#define TELEMETRY_UNITS_US	0
+#define TELEMETRY_UNITS_NS	1
+
+/* header state */
+#define TELEMETRY_STARTING	0
+#define TELEMETRY_RUNNING	1
+#define TELEMETRY_FINISHED	2
+
+/* header flags */
+#define TELEMETRY_HAS_QUANTILES	0x0001	/* winmax, m2 and quant[] are kept */
+
+struct telemetry_header {
+	char magic[4];
+	uint16_t version;
+	uint16_t units;
+	uint32_t header_size;
+	uint32_t slot_size;
+	uint32_t nthreads;
+	uint32_t state;
+	int32_t pid;
+	uint32_t hist_sub_bits;	/* see histogram.h */
+	uint32_t hist_nbuckets;
+	uint32_t flags;
+	uint64_t hist_limit;
+	uint64_t start_sec;	/* CLOCK_REALTIME at start of the test */
+	double quantile[TELEMETRY_QUANTILES];	/* percentiles of slot quant[] */
+};
+
+struct telemetry_slot {
+	uint32_t seq;
+	int32_t tid;
+	int32_t prio;
+	uint32_t interval;	/* in us */
+	uint64_t cycles;
+	int64_t min;
+	int64_t max;
+	int64_t act;
+	int64_t winmax;		/* max of the current display window */
+	double sum;		/* avg = sum / cycles */
+	double m2;		/* stddev = sqrt(m2 / (cycles - 1)) */
+	double quant[TELEMETRY_QUANTILES];
+	uint64_t overflow;	/* samples past the histogram range */
+	uint64_t overflow_max;
+	uint64_t counts[];
+};
+
+/* reader side, see telemetry.c */
+struct telemetry {
+	const struct telemetry_header *hdr;
+	size_t size;
+};
+
+int telemetry_attach(struct telemetry *t, const char *name);
+void telemetry_detach(struct telemetry *t);
+int telemetry_read(const struct telemetry *t, unsigned int thread,
+		   struct telemetry_slot *slot, uint64_t *counts);
+
+static inline size_t telemetry_slot_size(unsigned int nbuckets)
+{
+	size_t size = sizeof(struct telemetry_slot) + nbuckets * sizeof(uint64_t);
+
+	return (size + TELEMETRY_ALIGN - 1) & ~(size_t)(TELEMETRY_ALIGN - 1);
+}
+
+static inline struct telemetry_slot *
+telemetry_slot(const struct telemetry_header *hdr, unsigned int thread)
+{
+	return (struct telemetry_slot *)((char *)hdr + hdr->header_size +
+					 (size_t)thread * hdr->slot_size);
+}
+
+#endif	/* __TELEMETRY_H */
@@ -0,0 +1,121 @@
+/*
+ * Cycle counter calibration for cyclictest --tsc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ */
+#include <errno.h>
+#include "tsc.h"
+
+#define NSEC_PER_SEC	1000000000LL
+
+#if TSC_SUPPORTED
+
+/* clock reads per pair, the one with the shortest bracket wins */
+#define PAIR_TRIES	8
+
+/*
+ * Read the clock between two counter reads and return the counter
+ * value at the middle of the shortest bracket out of a few tries.
+ */
+static int tsc_pair(clockid_t clock, uint64_t *cycles, int64_t *ns)
+{
+	uint64_t c0, c1, best = UINT64_MAX;
+	struct timespec ts;
+	int i;
+
+	for (i = 0; i < PAIR_TRIES; i++) {
+		c0 = tsc_read();
+		if (clock_gettime(clock, &ts))
+			return -1;
+		c1 = tsc_read();
+		if (c1 - c0 < best) {
+			best = c1 - c0;
+			*cycles = c0 + (c1 - c0) / 2;
+			*ns = (int64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+		}
+	}
+	return 0;
+}
+
+static void tsc_rate(struct tsc_clock *c, uint64_t cycles, int64_t ns)
+{
+	c->mult = (uint64_t)(((unsigned __int128)(ns - c->origin_ns) << TSC_SHIFT) /
+			     (cycles - c->origin_cycles));
+}
+
+/*
+ * Measure the counter rate against clock over msecs milliseconds.
+ * Returns -1 with errno set if there is no usable counter.
+ */
+int tsc_calibrate(struct tsc_clock *c, clockid_t clock, int msecs)
+{
+	struct timespec wait = {
+		.tv_sec = msecs / 1000,
+		.tv_nsec = (msecs % 1000) * 1000000L,
+	};
+	uint64_t cycles;
+	int64_t ns;
+
+	c->clock = clock;
+	if (tsc_pair(clock, &c->origin_cycles, &c->origin_ns))
+		return -1;
+	while (clock_nanosleep(CLOCK_MONOTONIC, 0, &wait, &wait) == EINTR)
+		;
+	if (tsc_pair(clock, &cycles, &ns))
+		return -1;
+	if (cycles <= c->origin_cycles || ns <= c->origin_ns) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	tsc_rate(c, cycles, ns);
+	c->base_cycles = cycles;
+	c->base_ns = ns;
+	return 0;
+}
+
+/*
+ * Re-anchor the conversion at the current time. Returns by how many
+ * ns the counter based time was ahead of the clock before that.
+ */
+int64_t tsc_resync(struct tsc_clock *c)
+{
+	uint64_t cycles;
+	int64_t ns, offset;
+
+	if (tsc_pair(c->clock, &cycles, &ns))
+		return 0;
+	offset = tsc_to_ns(c, cycles) - ns;
+	tsc_rate(c, cycles, ns);
+	c->base_cycles = cycles;
+	c->base_ns = ns;
+	return offset;
+}
+
+uint64_t tsc_hz(const struct tsc_clock *c)
+{
+	return c->mult ? (uint64_t)(((unsigned __int128)NSEC_PER_SEC << TSC_SHIFT) /
+				   c->mult) : 0;
+}
+
+#else
+
+int tsc_calibrate(struct tsc_clock *c, clockid_t clock, int msecs)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+int64_t tsc_resync(struct tsc_clock *c)
+{
+	return 0;
+}
+
+uint64_t tsc_hz(const struct tsc_clock *c)
+{
+	return 0;
+}
+
+#endif	/* TSC_SUPPORTED */
@@ -0,0 +1,67 @@
+/*
+ * tsc.h - CPU cycle counter as a timestamp source
+ *
+ * The counter is converted to the time base of a POSIX clock with a
+ * fixed point multiplier that is calibrated at start up. Every owner
+ * of a struct tsc_clock re-anchors it against the clock now and then
+ * (tsc_resync), which removes the accumulated offset and refines the
+ * rate over the whole run, so the conversion does not drift away.
+ */
+
+#ifndef __TSC_H
+#define __TSC_H
+
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__aarch64__)
+#define TSC_SUPPORTED	1
+#else
+#define TSC_SUPPORTED	0
+#endif
+
+#define TSC_SHIFT	32
+
+struct tsc_clock {
+	clockid_t clock;
+	uint64_t origin_cycles;		/* calibration start, for the rate */
+	int64_t origin_ns;
+	uint64_t base_cycles;		/* last anchor, for the offset */
+	int64_t base_ns;
+	uint64_t mult;			/* ns per cycle << TSC_SHIFT */
+};
+
+static inline uint64_t tsc_read(void)
+{
+#if defined(__x86_64__)
+	uint32_t lo, hi;
+
+	/* rdtscp waits for all earlier instructions */
+	__asm__ __volatile__("rdtscp" : "=a" (lo), "=d" (hi) : : "rcx");
+	return ((uint64_t)hi << 32) | lo;
+#elif defined(__aarch64__)
+	uint64_t val;
+
+	__asm__ __volatile__("isb; mrs %0, cntvct_el0" : "=r" (val) : : "memory");
+	return val;
+#else
+	return 0;
+#endif
+}
+
+static inline int64_t tsc_to_ns(const struct tsc_clock *c, uint64_t cycles)
+{
+#if TSC_SUPPORTED
+	__int128 delta = (int64_t)(cycles - c->base_cycles);
+
+	return c->base_ns + (int64_t)((delta * c->mult) >> TSC_SHIFT);
+#else
+	return 0;
+#endif
+}
+
+int tsc_calibrate(struct tsc_clock *c, clockid_t clock, int msecs);
+int64_t tsc_resync(struct tsc_clock *c);
+uint64_t tsc_hz(const struct tsc_clock *c);
+
+#endif	/* __TSC_H */
@@ -0,0 +1,272 @@
+/*
+ * Per cycle workload for cyclictest --work
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dlfcn.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include "work.h"
+
+/* eviction buffer if the size of the last level cache is not known */
+#define WORK_EVICT_DEFAULT	(8 << 20)
+
+/* keeps the compiler from dropping the kernels */
+static volatile double work_sink;
+
+#if defined(__x86_64__) || defined(__i386__)
+#define WORK_FLUSH	1
+static inline void work_flush_line(char *p)
+{
+	__asm__ __volatile__("clflush %0" : "+m" (*(volatile char *)p));
+}
+
+static inline void work_flush_done(void)
+{
+	__asm__ __volatile__("mfence" ::: "memory");
+}
+#elif defined(__aarch64__)
+#define WORK_FLUSH	1
+static inline void work_flush_line(char *p)
+{
+	__asm__ __volatile__("dc civac, %0" : : "r" (p) : "memory");
+}
+
+static inline void work_flush_done(void)
+{
+	__asm__ __volatile__("dsb ish" ::: "memory");
+}
+#else
+#define WORK_FLUSH	0
+#endif
+
+/*
+ * matvec:N, memcpy:KB or the path of a shared object, optionally
+ * followed by :ARG for its cyclictest_work_init().
+ */
+int work_parse(struct work_spec *spec, const char *arg)
+{
+	const char *colon = strchr(arg, ':');
+
+	memset(spec, 0, sizeof(*spec));
+	if (!strncmp(arg, "matvec", 6) && (!arg[6] || arg[6] == ':')) {
+		spec->kind = WORK_MATVEC;
+		spec->size = colon ? atoi(colon + 1) : 64;
+	} else if (!strncmp(arg, "memcpy", 6) && (!arg[6] || arg[6] == ':')) {
+		spec->kind = WORK_MEMCPY;
+		spec->size = colon ? atoi(colon + 1) : 64;
+	} else {
+		size_t len = colon ? (size_t)(colon - arg) : strlen(arg);
+
+		if (!len || len >= sizeof(spec->arg))
+			return -1;
+		spec->kind = WORK_MODULE;
+		memcpy(spec->arg, arg, len);
+		if (colon)
+			snprintf(spec->modarg, sizeof(spec->modarg), "%s", colon + 1);
+		return 0;
+	}
+	return spec->size > 0 ? 0 : -1;
+}
+
+/* Largest cache of cpu from sysfs, 0 if it is not known */
+static size_t work_llc_size(int cpu)
+{
+	char path[96], unit;
+	size_t size, max = 0;
+	FILE *fp;
+	int i;
+
+	for (i = 0; cpu >= 0; i++) {
+		snprintf(path, sizeof(path),
+			 "/sys/devices/system/cpu/cpu%d/cache/index%d/size", cpu, i);
+		fp = fopen(path, "r");
+		if (!fp)
+			break;
+		unit = 0;
+		if (fscanf(fp, "%zu%c", &size, &unit) >= 1) {
+			if (unit == 'K')
+				size <<= 10;
+			else if (unit == 'M')
+				size <<= 20;
+			if (size > max)
+				max = size;
+		}
+		fclose(fp);
+	}
+	return max;
+}
+
+static inline int64_t work_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*
+ * Set up the work of one thread, on that thread so that the memory
+ * is first touched on its node. With cold set work_evict() pushes the
+ * work out of the caches, how long that takes is left in evict_ns.
+ */
+int work_init(struct work *w, const struct work_spec *spec, int thread,
+	      int cold)
+{
+	size_t n = spec->size, i;
+	void *(*init)(int, const char *);
+	long line;
+	int64_t start;
+
+	memset(w, 0, sizeof(*w));
+	w->spec = spec;
+
+	switch (spec->kind) {
+	case WORK_MATVEC:
+		w->matrix = malloc(n * n * sizeof(double));
+		w->in = malloc(n * sizeof(double));
+		w->out = malloc(n * sizeof(double));
+		if (!w->matrix || !w->in || !w->out)
+			return -1;
+		/* rows sum up to 1, the vector stays at 1.0 */
+		for (i = 0; i < n * n; i++)
+			w->matrix[i] = 1.0 / n;
+		for (i = 0; i < n; i++)
+			w->in[i] = 1.0;
+		break;
+
+	case WORK_MEMCPY:
+		w->src = malloc(n * 1024);
+		w->dst = malloc(n * 1024);
+		if (!w->src || !w->dst)
+			return -1;
+		memset(w->src, 1, n * 1024);
+		memset(w->dst, 0, n * 1024);
+		break;
+
+	case WORK_MODULE:
+		w->handle = dlopen(spec->arg, RTLD_NOW|RTLD_LOCAL);
+		if (!w->handle) {
+			fprintf(stderr, "%s\n", dlerror());
+			errno = ENOENT;
+			return -1;
+		}
+		w->run = (void (*)(void *))dlsym(w->handle, "cyclictest_work");
+		if (!w->run) {
+			errno = ENOENT;
+			return -1;
+		}
+		init = (void *(*)(int, const char *))
+			dlsym(w->handle, "cyclictest_work_init");
+		w->exit = (void (*)(void *))dlsym(w->handle, "cyclictest_work_exit");
+		if (init)
+			w->ctx = init(thread, spec->modarg);
+		break;
+	}
+
+	if (!cold)
+		return 0;
+	line = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+	w->line = line > 0 ? line : 64;
+	if (!WORK_FLUSH || spec->kind == WORK_MODULE) {
+		w->evict_size = 2 * work_llc_size(sched_getcpu());
+		if (!w->evict_size)
+			w->evict_size = WORK_EVICT_DEFAULT;
+		w->evict = malloc(w->evict_size);
+		if (!w->evict)
+			return -1;
+		memset(w->evict, 0, w->evict_size);
+	}
+	start = work_now();
+	work_evict(w);
+	w->evict_ns = work_now() - start;
+	return 0;
+}
+
+void work_run(struct work *w)
+{
+	size_t n = w->spec->size, i, j;
+	double *tmp, sum;
+
+	switch (w->spec->kind) {
+	case WORK_MATVEC:
+		for (i = 0; i < n; i++) {
+			sum = 0.0;
+			for (j = 0; j < n; j++)
+				sum += w->matrix[i * n + j] * w->in[j];
+			w->out[i] = sum;
+		}
+		tmp = w->in;
+		w->in = w->out;
+		w->out = tmp;
+		work_sink = w->in[0];
+		break;
+
+	case WORK_MEMCPY:
+		memcpy(w->dst, w->src, n * 1024);
+		work_sink = w->dst[n * 1024 - 1];
+		break;
+
+	case WORK_MODULE:
+		w->run(w->ctx);
+		break;
+	}
+}
+
+#if WORK_FLUSH
+static void work_flush(struct work *w, void *buf, size_t len)
+{
+	char *p = (char *)((uintptr_t)buf & ~(uintptr_t)(w->line - 1));
+	char *end = (char *)buf + len;
+
+	if (!buf)
+		return;
+	for (; p < end; p += w->line)
+		work_flush_line(p);
+}
+#endif
+
+/*
+ * Flush the buffers of the work, or write a cache line of the eviction
+ * buffer after the other.
+ */
+void work_evict(struct work *w)
+{
+	size_t n = w->spec->size, i;
+
+	if (w->evict) {
+		for (i = 0; i < w->evict_size; i += w->line)
+			w->evict[i]++;
+		return;
+	}
+#if WORK_FLUSH
+	work_flush(w, w->matrix, n * n * sizeof(double));
+	work_flush(w, w->in, n * sizeof(double));
+	work_flush(w, w->out, n * sizeof(double));
+	work_flush(w, w->src, n * 1024);
+	work_flush(w, w->dst, n * 1024);
+	work_flush_done();
+#endif
+}
+
+void work_exit(struct work *w)
+{
+	if (w->exit)
+		w->exit(w->ctx);
+	if (w->handle)
+		dlclose(w->handle);
+	free(w->matrix);
+	free(w->in);
+	free(w->out);
+	free(w->src);
+	free(w->dst);
+	free(w->evict);
+	memset(w, 0, sizeof(*w));
+}
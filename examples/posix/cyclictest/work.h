@@ -0,0 +1,73 @@
+/*
+ * work.h - per cycle workload of cyclictest --work
+ *
+ * After every wakeup the measurement thread runs one unit of work, the
+ * way a control loop reads its inputs, computes and writes its outputs.
+ * Besides the built in kernels a shared object can be loaded, it has to
+ * export
+ *
+ *	void cyclictest_work(void *ctx);
+ *
+ * and may export
+ *
+ *	void *cyclictest_work_init(int thread, const char *arg);
+ *	void cyclictest_work_exit(void *ctx);
+ *
+ * cyclictest_work_init() runs once on each measurement thread before
+ * the first cycle, what it returns is passed to the other two.
+ *
+ * For cold cache runs work_evict() flushes the buffers of the built in
+ * kernels line by line. The memory of a shared object is not known, so
+ * for those, and where there is no flush instruction, it writes a
+ * buffer twice the size of the last level cache instead.
+ */
+
+#ifndef __WORK_H
+#define __WORK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define WORK_ARGLEN		256
+
+enum {
+	WORK_NONE,
+	WORK_MATVEC,		/* N x N matrix times vector, in doubles */
+	WORK_MEMCPY,		/* copy N KiB */
+	WORK_MODULE,		/* cyclictest_work() of a shared object */
+};
+
+/* What --work asked for, shared by all threads */
+struct work_spec {
+	int kind;
+	int size;
+	char arg[WORK_ARGLEN];	/* shared object path */
+	char modarg[WORK_ARGLEN];	/* passed to cyclictest_work_init() */
+};
+
+/* One thread's instance of the work */
+struct work {
+	const struct work_spec *spec;
+	double *matrix;
+	double *in;
+	double *out;
+	char *src;
+	char *dst;
+	void *handle;
+	void (*run)(void *ctx);
+	void (*exit)(void *ctx);
+	void *ctx;
+	size_t line;		/* cache line size */
+	char *evict;
+	size_t evict_size;
+	int64_t evict_ns;	/* one work_evict() as timed by work_init() */
+};
+
+int work_parse(struct work_spec *spec, const char *arg);
+int work_init(struct work *w, const struct work_spec *spec, int thread,
+	      int cold);
+void work_run(struct work *w);
+void work_evict(struct work *w);
+void work_exit(struct work *w);
+
+#endif	/* __WORK_H */